@@ -0,0 +1,165 @@
+#include "admission.h"
+
+void token_bucket_init(TokenBucket *bucket, double rate, double burst)
+{
+    bucket->rate = rate;
+    bucket->burst = burst;
+    bucket->tokens = burst;
+    clock_gettime(CLOCK_MONOTONIC, &bucket->last);
+}
+
+// Take one token, returns 0 on success or the milliseconds until the next
+// token is available
+int token_bucket_take(TokenBucket *bucket)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - bucket->last.tv_sec) + (now.tv_nsec - bucket->last.tv_nsec) / 1e9;
+    bucket->last = now;
+
+    bucket->tokens += elapsed * bucket->rate;
+    if (bucket->tokens > bucket->burst)
+    {
+        bucket->tokens = bucket->burst;
+    }
+
+    if (bucket->tokens >= 1.0)
+    {
+        bucket->tokens -= 1.0;
+        return 0;
+    }
+    return (int)((1.0 - bucket->tokens) * 1000.0 / bucket->rate) + 1;
+}
+
+int waiting_room_init(WaitingRoom *room, int capacity)
+{
+    room->players = capacity > 0 ? malloc(sizeof(WaitingPlayer) * capacity) : NULL;
+    room->capacity = room->players ? capacity : 0;
+    room->count = 0;
+    return capacity > 0 && room->players == NULL ? -1 : 0;
+}
+
+// Returns the 1-based place in the queue, or -1 when the room is full
+int waiting_room_push(WaitingRoom *room, int socket, unsigned int ip)
+{
+    if (room->count >= room->capacity)
+    {
+        return -1;
+    }
+    room->players[room->count].socket = socket;
+    room->players[room->count].ip = ip;
+    return ++room->count;
+}
+
+// Returns 0 when nobody is waiting
+int waiting_room_pop(WaitingRoom *room, WaitingPlayer *player)
+{
+    if (room->count == 0)
+    {
+        return 0;
+    }
+    *player = room->players[0];
+    room->count--;
+    memmove(room->players, room->players + 1, sizeof(WaitingPlayer) * room->count);
+    return 1;
+}
+
+// Returns 1 when the socket was waiting
+int waiting_room_remove(WaitingRoom *room, int socket)
+{
+    for (int i = 0; i < room->count; i++)
+    {
+        if (room->players[i].socket == socket)
+        {
+            room->count--;
+            memmove(room->players + i, room->players + i + 1, sizeof(WaitingPlayer) * (room->count - i));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int waiting_room_contains(WaitingRoom *room, int socket)
+{
+    for (int i = 0; i < room->count; i++)
+    {
+        if (room->players[i].socket == socket)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int ip_slot(IpTable *table, unsigned int ip)
+{
+    ip ^= ip >> 16;
+    ip *= 0x45d9f3b;
+    ip ^= ip >> 16;
+    return ip & table->mask;
+}
+
+// Sized for twice the connections the server can hold, so the table never
+// fills and probe runs stay short
+int ip_table_init(IpTable *table, int connections)
+{
+    int size = 16;
+    while (size < connections * 2)
+    {
+        size *= 2;
+    }
+    table->slots = calloc(size, sizeof(IpCount));
+    table->mask = size - 1;
+    return table->slots == NULL ? -1 : 0;
+}
+
+// Connections from one address, seated in games, waiting or in a tournament
+int ip_table_count(IpTable *table, unsigned int ip)
+{
+    for (int i = ip_slot(table, ip); table->slots[i].count > 0; i = (i + 1) & table->mask)
+    {
+        if (table->slots[i].ip == ip)
+        {
+            return table->slots[i].count;
+        }
+    }
+    return 0;
+}
+
+void ip_table_add(IpTable *table, unsigned int ip)
+{
+    int i = ip_slot(table, ip);
+    while (table->slots[i].count > 0 && table->slots[i].ip != ip)
+    {
+        i = (i + 1) & table->mask;
+    }
+    table->slots[i].ip = ip;
+    table->slots[i].count++;
+}
+
+void ip_table_remove(IpTable *table, unsigned int ip)
+{
+    int i = ip_slot(table, ip);
+    while (table->slots[i].count > 0 && table->slots[i].ip != ip)
+    {
+        i = (i + 1) & table->mask;
+    }
+    if (table->slots[i].count == 0 || --table->slots[i].count > 0)
+    {
+        return;
+    }
+
+    // Move later entries of the probe run into the hole when their home slot
+    // is not between the hole and them, so lookups never stop early
+    int hole = i;
+    for (int j = (i + 1) & table->mask; table->slots[j].count > 0; j = (j + 1) & table->mask)
+    {
+        int home = ip_slot(table, table->slots[j].ip);
+        if (((j - home) & table->mask) >= ((j - hole) & table->mask))
+        {
+            table->slots[hole] = table->slots[j];
+            table->slots[j].count = 0;
+            hole = j;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "utils.h"
+
+// Limits on who gets in when the server is busy: an accept rate limit, a
+// per address connection limit and a bounded queue of players waiting for
+// a free game. Connections per address are counted in a hash table kept up
+// to date as sockets are admitted and closed.
+
+typedef struct
+{
+    double tokens;
+    double rate;  // tokens added per second
+    double burst; // most tokens the bucket holds
+    struct timespec last;
+} TokenBucket;
+
+typedef struct
+{
+    int socket;
+    unsigned int ip;
+} WaitingPlayer;
+
+typedef struct
+{
+    unsigned int ip;
+    int count; // 0 marks a free slot
+} IpCount;
+
+typedef struct
+{
+    IpCount *slots; // open addressing with linear probing
+    int mask;
+} IpTable;
+
+typedef struct
+{
+    WaitingPlayer *players; // oldest first
+    int capacity;
+    int count;
+} WaitingRoom;
+
+void token_bucket_init(TokenBucket *bucket, double rate, double burst);
+int token_bucket_take(TokenBucket *bucket);
+int waiting_room_init(WaitingRoom *room, int capacity);
+int waiting_room_push(WaitingRoom *room, int socket, unsigned int ip);
+int waiting_room_pop(WaitingRoom *room, WaitingPlayer *player);
+int waiting_room_remove(WaitingRoom *room, int socket);
+int waiting_room_contains(WaitingRoom *room, int socket);
+int ip_table_init(IpTable *table, int connections);
+int ip_table_count(IpTable *table, unsigned int ip);
+void ip_table_add(IpTable *table, unsigned int ip);
+void ip_table_remove(IpTable *table, unsigned int ip);
+#endif // ADMISSION_H
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "utils.h"
+#include "fen.h"
+
+// Offline move validation, each input line is either
+//   <64 board squares, row 8 first> <w|b> <move>
+// or
+//   <FEN> <move>
+// for example
+//   rnbqkbnrpppppppp................................PPPPPPPPRNBQKBNR w e2e3
+//   rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 e2e3
+
+#define BATCH_SIZE 65536
+#define MAX_THREADS 64
+#define LINE_SIZE 256
+
+typedef struct
+{
+    MoveCheck *checks;
+    int count;
+} Slice;
+
+int threads = 1;
+int verbose = 0;
+
+void *validate_slice(void *arg)
+{
+    Slice *slice = (Slice *)arg;
+    validate_moves(slice->checks, slice->count);
+    return NULL;
+}
+
+// Split the batch between the worker threads, results stay in input order
+void validate_batch(MoveCheck *checks, int count)
+{
+    pthread_t workers[MAX_THREADS];
+    Slice slices[MAX_THREADS];
+    int per_thread = (count + threads - 1) / threads;
+    int started = 0;
+
+    for (int i = 0; i < threads && i * per_thread < count; i++)
+    {
+        slices[i].checks = checks + i * per_thread;
+        slices[i].count = count - i * per_thread < per_thread ? count - i * per_thread : per_thread;
+        if (pthread_create(&workers[i], NULL, validate_slice, &slices[i]) != 0)
+        {
+            // Fall back to validating this slice on the calling thread
+            validate_slice(&slices[i]);
+            continue;
+        }
+        started = i + 1;
+    }
+
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+// The move is the last word of a FEN line
+int parse_fen_line(char *line, MoveCheck *check)
+{
+    char *end = line + strlen(line);
+    while (end > line && isspace((unsigned char)end[-1]))
+    {
+        *--end = '\0';
+    }
+    char *move = strrchr(line, ' ');
+    if (move == NULL || strlen(move + 1) != 4)
+    {
+        return 0;
+    }
+    *move++ = '\0';
+
+    memset(&check->position, 0, sizeof(check->position));
+    if (load_fen(&check->position, line) != 0)
+    {
+        return 0;
+    }
+    check->isPlayerWhite = check->position.current_player == 1;
+    check->move = convert(move);
+    return 1;
+}
+
+// Returns 0 when the line could not be parsed
+int parse_line(char *line, MoveCheck *check)
+{
+    if (strchr(line, '/') != NULL)
+    {
+        return parse_fen_line(line, check);
+    }
+
+    char squares[LINE_SIZE];
+    char side;
+    char move[LINE_SIZE];
+
+    if (sscanf(line, "%255s %c %255s", squares, &side, move) != 3 ||
+        strlen(squares) != 64 || strlen(move) != 4 || (side != 'w' && side != 'b'))
+    {
+        return 0;
+    }
+
+    memset(&check->position, 0, sizeof(check->position));
+    memcpy(check->position.board, squares, 64);
+    locate_kings(&check->position);
+    check->isPlayerWhite = side == 'w';
+    check->position.current_player = check->isPlayerWhite ? 1 : 2;
+    check->move = convert(move);
+    return 1;
+}
+
+void report_batch(MoveCheck *checks, int *parsed, int count, long first_line, long *valid, long *invalid)
+{
+    for (int i = 0; i < count; i++)
+    {
+        long line_number = first_line + i;
+        if (!parsed[i])
+        {
+            printf("%ld: parse error\n", line_number);
+            (*invalid)++;
+        }
+        else if (checks[i].status != MOVE_VALID)
+        {
+            printf("%ld: %s\n", line_number, move_status_message(checks[i].status));
+            (*invalid)++;
+        }
+        else
+        {
+            if (verbose)
+            {
+                printf("%ld: valid\n", line_number);
+            }
+            (*valid)++;
+        }
+    }
+}
+
+void usage(char *name)
+{
+    printf("usage: %s [-j THREADS] [-v] [FILE]\n", name);
+    printf("OPTIONS\n");
+    printf("  -j --threads THREADS  validate with THREADS threads\n");
+    printf("  -v --verbose          print valid moves too\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+        {
+            verbose = 1;
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+
+    if (threads < 1 || threads > MAX_THREADS)
+    {
+        usage(argv[0]);
+    }
+
+    FILE *input = path ? fopen(path, "r") : stdin;
+    if (input == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    MoveCheck *checks = malloc(sizeof(MoveCheck) * BATCH_SIZE);
+    int *parsed = malloc(sizeof(int) * BATCH_SIZE);
+    if (checks == NULL || parsed == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    char line[LINE_SIZE];
+    long line_number = 1;
+    long valid = 0;
+    long invalid = 0;
+    int count = 0;
+
+    while (fgets(line, LINE_SIZE, input) != NULL)
+    {
+        parsed[count] = parse_line(line, &checks[count]);
+        if (!parsed[count])
+        {
+            // Unparsed entries keep a harmless no-op move so the batch stays dense
+            memset(&checks[count], 0, sizeof(MoveCheck));
+        }
+        count++;
+
+        if (count == BATCH_SIZE)
+        {
+            validate_batch(checks, count);
+            report_batch(checks, parsed, count, line_number, &valid, &invalid);
+            line_number += count;
+            count = 0;
+        }
+    }
+
+    if (count > 0)
+    {
+        validate_batch(checks, count);
+        report_batch(checks, parsed, count, line_number, &valid, &invalid);
+    }
+
+    fprintf(stderr, "%ld valid, %ld invalid\n", valid, invalid);
+
+    free(checks);
+    free(parsed);
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    return invalid > 0;
+}
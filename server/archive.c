@@ -0,0 +1,109 @@
+#include "archive.h"
+#include "history.h"
+#include "pool.h"
+#include <fcntl.h>
+
+typedef struct
+{
+    ChessGame game; // its history is a snapshot owned by the job
+    int fd;
+    int result;
+} ArchiveJob;
+
+// Returns the descriptor games are appended to, -1 on failure
+int archive_open(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        perror("archive open");
+    }
+    return fd;
+}
+
+// Append the game with a single write, the check and mate verdicts are the
+// ones play_move stored in the history
+int archive_write_game(int fd, ChessGame *game, int result)
+{
+    size_t size = sizeof(ArchiveRecord) + sizeof(ArchiveMove) * game->history.count;
+    char *buffer = calloc(1, size);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    ArchiveRecord *record = (ArchiveRecord *)buffer;
+    ArchiveMove *moves = (ArchiveMove *)(buffer + sizeof(ArchiveRecord));
+    record->magic = ARCHIVE_MAGIC;
+    record->move_count = game->history.count;
+    record->result = result;
+    memcpy(record->start_fen, game->start_fen, FEN_MAX_LENGTH);
+
+    for (int i = 0; i < game->history.count; i++)
+    {
+        int state = history_state(&game->history, i);
+        history_get(&game->history, i, &moves[i].move, &moves[i].captured);
+        moves[i].state = (state & MOVE_CHECK ? ARCHIVE_CHECK : 0) | (state & MOVE_MATE ? ARCHIVE_MATE : 0);
+    }
+
+    ssize_t written = write(fd, buffer, size);
+    free(buffer);
+    return written == (ssize_t)size ? 0 : -1;
+}
+
+static void run_archive(void *arg)
+{
+    ArchiveJob *job = (ArchiveJob *)arg;
+    // O_APPEND makes every record one write at the end, whichever worker wins
+    if (archive_write_game(job->fd, &job->game, job->result) < 0)
+    {
+        printf("Could not archive game %d\n", job->game.game_id);
+    }
+    history_free_snapshot(&job->game.history);
+    free(job);
+}
+
+// Queue the game for a worker to write, returns -1 when the queue is full or
+// out of memory. The descriptor must stay open until the pool stopped.
+int archive_request(int fd, ChessGame *game, int result)
+{
+    ArchiveJob *job = malloc(sizeof(ArchiveJob));
+    if (job == NULL)
+    {
+        return -1;
+    }
+    job->game = *game;
+    job->fd = fd;
+    job->result = result;
+    if (history_snapshot(&game->history, &job->game.history) < 0)
+    {
+        free(job);
+        return -1;
+    }
+
+    if (pool_submit(run_archive, job) < 0)
+    {
+        history_free_snapshot(&job->game.history);
+        free(job);
+        return -1;
+    }
+    return 0;
+}
+
+// The record at the offset, which is moved past it. Returns NULL at the end
+// of the data or when the record is damaged.
+const ArchiveRecord *archive_next(const char *data, size_t size, size_t *offset)
+{
+    if (size - *offset < sizeof(ArchiveRecord))
+    {
+        return NULL;
+    }
+    const ArchiveRecord *record = (const ArchiveRecord *)(data + *offset);
+    size_t length = sizeof(ArchiveRecord) + sizeof(ArchiveMove) * (size_t)record->move_count;
+    if (record->magic != ARCHIVE_MAGIC || length > size - *offset)
+    {
+        return NULL;
+    }
+    *offset += length;
+    return record;
+}
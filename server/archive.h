@@ -0,0 +1,42 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "utils.h"
+#include "fen.h"
+
+// Finished games are appended to the archive as a record followed by its
+// moves. Every move carries what the rules said when it was played, so a
+// replay with newer rule code can spot any change in behaviour.
+
+#define ARCHIVE_MAGIC 0x52414843 // "CHAR"
+
+#define ARCHIVE_ABORTED 0
+#define ARCHIVE_WHITE_WINS 1
+#define ARCHIVE_BLACK_WINS 2
+#define ARCHIVE_DRAW 3
+
+// Move state bits
+#define ARCHIVE_CHECK 1 // the opponent is in check after the move
+#define ARCHIVE_MATE 2  // is_checkmate declared mate after the move
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t move_count;
+    uint8_t result;
+    uint8_t reserved[3];
+    char start_fen[FEN_MAX_LENGTH];
+} ArchiveRecord;
+
+typedef struct
+{
+    PackedMove move;
+    char captured;
+    uint8_t state;
+} ArchiveMove;
+
+int archive_open(const char *path);
+int archive_write_game(int fd, ChessGame *game, int result);
+int archive_request(int fd, ChessGame *game, int result);
+const ArchiveRecord *archive_next(const char *data, size_t size, size_t *offset);
+#endif // ARCHIVE_H
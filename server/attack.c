@@ -0,0 +1,388 @@
+#include "attack.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ATTACK_HAVE_X86 1
+#endif
+
+// Squares are numbered row * 8 + col, so bit 0 is a8 and bit 63 is h1.
+// The vector backends compare the whole 64 byte board against the attacking
+// pieces at once and turn the result into bit masks, the rays are then
+// resolved with a couple of bit operations instead of walking the board.
+
+typedef struct
+{
+    uint64_t occupied;
+    uint64_t diagonal; // queens and bishops of the attacker
+    uint64_t straight; // queens and rooks of the attacker
+    uint64_t knight;
+} AttackMasks;
+
+// Every query exists once per attacking color with the piece letters
+// compiled in, the public functions pick one by indexing with isPlayerWhite.
+// Index 0 looks for white attackers, index 1 for black ones.
+typedef void (*MaskBuilder)(char board[8][8], AttackMasks *masks);
+typedef int (*ScalarCheck)(char board[8][8], Tile *tile);
+
+// Row and column step of every ray, diagonals first
+static const int ray_directions[8][2] = {
+    {1, 1}, {1, -1}, {-1, -1}, {-1, 1}, {1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+
+static uint64_t rays[64][8];
+static uint64_t knight_squares[64];
+static AttackBackend backend = ATTACK_SCALAR;
+static const MaskBuilder *build_masks = NULL;
+
+static const int diagonal_steps[4][2] = {
+    {1, 1},   // up-right
+    {1, -1},  // up-left
+    {-1, -1}, // down-left
+    {-1, 1}   // down-right
+};
+
+static const int straight_steps[4][2] = {
+    {1, 0},  // down
+    {0, 1},  // right
+    {-1, 0}, // up
+    {0, -1}  // left
+};
+
+static const int knight_steps[8][2] = {
+    {2, 1}, {1, 2}, {2, -1}, {1, -2}, {-2, 1}, {-1, 2}, {-2, -1}, {-1, -2}};
+
+// Walk the four rays until the edge of the board or the first piece
+static inline __attribute__((always_inline)) int walk_rays(char board[8][8], Tile *tile, const int steps[4][2],
+                                                           char queen, char slider)
+{
+    for (int dir = 0; dir < 4; dir++)
+    {
+        int col = tile->col + steps[dir][0];
+        int row = tile->row + steps[dir][1];
+
+        while (col >= 0 && col < 8 && row >= 0 && row < 8)
+        {
+            char piece = board[row][col];
+            if (piece == queen || piece == slider)
+            {
+                return 1;
+            }
+            if (piece != '.')
+            {
+                break;
+            }
+            col += steps[dir][0];
+            row += steps[dir][1];
+        }
+    }
+    return 0;
+}
+
+static inline __attribute__((always_inline)) int find_knight(char board[8][8], Tile *tile, char knight)
+{
+    for (int dir = 0; dir < 8; dir++)
+    {
+        int col = tile->col + knight_steps[dir][0];
+        int row = tile->row + knight_steps[dir][1];
+
+        if (col >= 0 && col < 8 && row >= 0 && row < 8 && board[row][col] == knight)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#define DEFINE_SCALAR_CHECKS(color, queen, bishop, rook, knight)           \
+    static int diagonals_by_##color(char board[8][8], Tile *tile)          \
+    {                                                                      \
+        return walk_rays(board, tile, diagonal_steps, queen, bishop);      \
+    }                                                                      \
+    static int straights_by_##color(char board[8][8], Tile *tile)          \
+    {                                                                      \
+        return walk_rays(board, tile, straight_steps, queen, rook);        \
+    }                                                                      \
+    static int knight_by_##color(char board[8][8], Tile *tile)             \
+    {                                                                      \
+        return find_knight(board, tile, knight);                           \
+    }                                                                      \
+    static int attacked_by_##color(char board[8][8], Tile *tile)           \
+    {                                                                      \
+        return walk_rays(board, tile, diagonal_steps, queen, bishop) ||    \
+               walk_rays(board, tile, straight_steps, queen, rook) ||      \
+               find_knight(board, tile, knight);                           \
+    }
+
+DEFINE_SCALAR_CHECKS(white, 'Q', 'B', 'R', 'N')
+DEFINE_SCALAR_CHECKS(black, 'q', 'b', 'r', 'n')
+
+static const ScalarCheck scalar_diagonals[2] = {diagonals_by_white, diagonals_by_black};
+static const ScalarCheck scalar_straights[2] = {straights_by_white, straights_by_black};
+static const ScalarCheck scalar_knights[2] = {knight_by_white, knight_by_black};
+static const ScalarCheck scalar_attacked[2] = {attacked_by_white, attacked_by_black};
+
+int check_diagonals_scalar(char board[8][8], Tile *tile, int isPlayerWhite)
+{
+    return scalar_diagonals[isPlayerWhite != 0](board, tile);
+}
+
+int check_straights_scalar(char board[8][8], Tile *tile, int isPlayerWhite)
+{
+    return scalar_straights[isPlayerWhite != 0](board, tile);
+}
+
+int check_knight_scalar(char board[8][8], Tile *tile, int isPlayerWhite)
+{
+    return scalar_knights[isPlayerWhite != 0](board, tile);
+}
+
+#ifdef ATTACK_HAVE_X86
+static inline __attribute__((always_inline)) void build_masks_sse2(char board[8][8], AttackMasks *masks, char queen_piece,
+                                                                  char bishop_piece, char rook_piece, char knight_piece)
+{
+    const char *squares = &board[0][0];
+    const __m128i empty = _mm_set1_epi8('.');
+    const __m128i queen = _mm_set1_epi8(queen_piece);
+    const __m128i bishop = _mm_set1_epi8(bishop_piece);
+    const __m128i rook = _mm_set1_epi8(rook_piece);
+    const __m128i knight = _mm_set1_epi8(knight_piece);
+
+    memset(masks, 0, sizeof(AttackMasks));
+    for (int i = 0; i < 4; i++)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(squares + 16 * i));
+        __m128i queens = _mm_cmpeq_epi8(v, queen);
+        uint64_t occupied = (uint16_t)~_mm_movemask_epi8(_mm_cmpeq_epi8(v, empty));
+        uint64_t diagonal = (uint16_t)_mm_movemask_epi8(_mm_or_si128(queens, _mm_cmpeq_epi8(v, bishop)));
+        uint64_t straight = (uint16_t)_mm_movemask_epi8(_mm_or_si128(queens, _mm_cmpeq_epi8(v, rook)));
+        uint64_t knights = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, knight));
+
+        masks->occupied |= occupied << (16 * i);
+        masks->diagonal |= diagonal << (16 * i);
+        masks->straight |= straight << (16 * i);
+        masks->knight |= knights << (16 * i);
+    }
+}
+
+__attribute__((target("avx2"))) static inline __attribute__((always_inline)) void build_masks_avx2(
+    char board[8][8], AttackMasks *masks, char queen_piece, char bishop_piece, char rook_piece, char knight_piece)
+{
+    const char *squares = &board[0][0];
+    const __m256i empty = _mm256_set1_epi8('.');
+    const __m256i queen = _mm256_set1_epi8(queen_piece);
+    const __m256i bishop = _mm256_set1_epi8(bishop_piece);
+    const __m256i rook = _mm256_set1_epi8(rook_piece);
+    const __m256i knight = _mm256_set1_epi8(knight_piece);
+
+    memset(masks, 0, sizeof(AttackMasks));
+    for (int i = 0; i < 2; i++)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(squares + 32 * i));
+        __m256i queens = _mm256_cmpeq_epi8(v, queen);
+        uint64_t occupied = (uint32_t)~_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, empty));
+        uint64_t diagonal = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(queens, _mm256_cmpeq_epi8(v, bishop)));
+        uint64_t straight = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(queens, _mm256_cmpeq_epi8(v, rook)));
+        uint64_t knights = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, knight));
+
+        masks->occupied |= occupied << (32 * i);
+        masks->diagonal |= diagonal << (32 * i);
+        masks->straight |= straight << (32 * i);
+        masks->knight |= knights << (32 * i);
+    }
+}
+
+#define DEFINE_MASK_BUILDERS(color, queen, bishop, rook, knight)                              \
+    static void build_masks_sse2_##color(char board[8][8], AttackMasks *masks)                \
+    {                                                                                         \
+        build_masks_sse2(board, masks, queen, bishop, rook, knight);                          \
+    }                                                                                         \
+    __attribute__((target("avx2"))) static void build_masks_avx2_##color(char board[8][8],    \
+                                                                         AttackMasks *masks)  \
+    {                                                                                         \
+        build_masks_avx2(board, masks, queen, bishop, rook, knight);                          \
+    }
+
+DEFINE_MASK_BUILDERS(white, 'Q', 'B', 'R', 'N')
+DEFINE_MASK_BUILDERS(black, 'q', 'b', 'r', 'n')
+
+static const MaskBuilder sse2_builders[2] = {build_masks_sse2_white, build_masks_sse2_black};
+static const MaskBuilder avx2_builders[2] = {build_masks_avx2_white, build_masks_avx2_black};
+#endif
+
+// The first piece on the ray decides, rays pointing down the board hit the
+// lowest set bit first and rays pointing up hit the highest one
+static int ray_attacked(AttackMasks *masks, uint64_t attackers, int square, int dir)
+{
+    uint64_t blockers = masks->occupied & rays[square][dir];
+    if (blockers == 0)
+    {
+        return 0;
+    }
+    int is_forward = ray_directions[dir][0] > 0 || (ray_directions[dir][0] == 0 && ray_directions[dir][1] > 0);
+    int first = is_forward ? __builtin_ctzll(blockers) : 63 - __builtin_clzll(blockers);
+    return (attackers >> first) & 1;
+}
+
+static int diagonals_attacked(AttackMasks *masks, int square)
+{
+    return ray_attacked(masks, masks->diagonal, square, 0) ||
+           ray_attacked(masks, masks->diagonal, square, 1) ||
+           ray_attacked(masks, masks->diagonal, square, 2) ||
+           ray_attacked(masks, masks->diagonal, square, 3);
+}
+
+static int straights_attacked(AttackMasks *masks, int square)
+{
+    return ray_attacked(masks, masks->straight, square, 4) ||
+           ray_attacked(masks, masks->straight, square, 5) ||
+           ray_attacked(masks, masks->straight, square, 6) ||
+           ray_attacked(masks, masks->straight, square, 7);
+}
+
+static int is_on_board(Tile *tile)
+{
+    return tile->row >= 0 && tile->row < 8 && tile->col >= 0 && tile->col < 8;
+}
+
+int check_diagonals(char board[8][8], Tile *tile, int isPlayerWhite)
+{
+    if (build_masks == NULL || !is_on_board(tile))
+    {
+        return check_diagonals_scalar(board, tile, isPlayerWhite);
+    }
+    AttackMasks masks;
+    build_masks[isPlayerWhite != 0](board, &masks);
+    return diagonals_attacked(&masks, tile->row * 8 + tile->col);
+}
+
+int check_straights(char board[8][8], Tile *tile, int isPlayerWhite)
+{
+    if (build_masks == NULL || !is_on_board(tile))
+    {
+        return check_straights_scalar(board, tile, isPlayerWhite);
+    }
+    AttackMasks masks;
+    build_masks[isPlayerWhite != 0](board, &masks);
+    return straights_attacked(&masks, tile->row * 8 + tile->col);
+}
+
+int check_knight(char board[8][8], Tile *tile, int isPlayerWhite)
+{
+    if (build_masks == NULL || !is_on_board(tile))
+    {
+        return check_knight_scalar(board, tile, isPlayerWhite);
+    }
+    AttackMasks masks;
+    build_masks[isPlayerWhite != 0](board, &masks);
+    return (knight_squares[tile->row * 8 + tile->col] & masks.knight) != 0;
+}
+
+// All three queries with a single pass over the board
+int is_tile_attacked(char board[8][8], Tile *tile, int isPlayerWhite)
+{
+    if (build_masks == NULL || !is_on_board(tile))
+    {
+        return scalar_attacked[isPlayerWhite != 0](board, tile);
+    }
+    AttackMasks masks;
+    build_masks[isPlayerWhite != 0](board, &masks);
+    int square = tile->row * 8 + tile->col;
+    return (knight_squares[square] & masks.knight) != 0 ||
+           diagonals_attacked(&masks, square) ||
+           straights_attacked(&masks, square);
+}
+
+// Returns -1 when the CPU does not support the backend
+int set_attack_backend(AttackBackend requested)
+{
+    switch (requested)
+    {
+    case ATTACK_SCALAR:
+        build_masks = NULL;
+        break;
+#ifdef ATTACK_HAVE_X86
+    case ATTACK_SSE2:
+        if (!__builtin_cpu_supports("sse2"))
+        {
+            return -1;
+        }
+        build_masks = sse2_builders;
+        break;
+    case ATTACK_AVX2:
+        if (!__builtin_cpu_supports("avx2"))
+        {
+            return -1;
+        }
+        build_masks = avx2_builders;
+        break;
+#endif
+    default:
+        return -1;
+    }
+    backend = requested;
+    return 0;
+}
+
+AttackBackend get_attack_backend(void)
+{
+    return backend;
+}
+
+const char *attack_backend_name(AttackBackend requested)
+{
+    switch (requested)
+    {
+    case ATTACK_SCALAR:
+        return "scalar";
+    case ATTACK_SSE2:
+        return "sse2";
+    case ATTACK_AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+// Precompute the rays and knight jumps and pick the fastest backend
+__attribute__((constructor)) static void init_attack_tables(void)
+{
+    for (int square = 0; square < 64; square++)
+    {
+        int row = square / 8;
+        int col = square % 8;
+
+        for (int dir = 0; dir < 8; dir++)
+        {
+            uint64_t ray = 0;
+            int r = row + ray_directions[dir][0];
+            int c = col + ray_directions[dir][1];
+            while (r >= 0 && r < 8 && c >= 0 && c < 8)
+            {
+                ray |= 1ULL << (r * 8 + c);
+                r += ray_directions[dir][0];
+                c += ray_directions[dir][1];
+            }
+            rays[square][dir] = ray;
+        }
+
+        uint64_t jumps = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            int r = row + knight_steps[i][0];
+            int c = col + knight_steps[i][1];
+            if (r >= 0 && r < 8 && c >= 0 && c < 8)
+            {
+                jumps |= 1ULL << (r * 8 + c);
+            }
+        }
+        knight_squares[square] = jumps;
+    }
+
+#ifdef ATTACK_HAVE_X86
+    __builtin_cpu_init();
+    if (set_attack_backend(ATTACK_AVX2) != 0)
+    {
+        set_attack_backend(ATTACK_SSE2);
+    }
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef ATTACK_H
+#define ATTACK_H
+
+#include "utils.h"
+
+// Implementations of the attack queries, picked at startup from the CPU features
+typedef enum
+{
+    ATTACK_SCALAR = 0,
+    ATTACK_SSE2,
+    ATTACK_AVX2
+} AttackBackend;
+
+int check_diagonals_scalar(char board[8][8], Tile *tile, int isPlayerWhite);
+int check_straights_scalar(char board[8][8], Tile *tile, int isPlayerWhite);
+int check_knight_scalar(char board[8][8], Tile *tile, int isPlayerWhite);
+int set_attack_backend(AttackBackend backend);
+AttackBackend get_attack_backend(void);
+const char *attack_backend_name(AttackBackend backend);
+#endif // ATTACK_H
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+#include "utils.h"
+#include "queue.h"
+#include "fen.h"
+#include "attack.h"
+
+// Microbenchmarks, run all of them or the ones named on the command line:
+//   queue     enqueue cost and end-to-end latency of the event rings
+//   validate  move validation and attack queries over positions from random games
+
+#define QUEUE_EVENTS 4000000
+#define QUEUE_CAPACITY 4096
+#define QUEUE_BATCH 64
+#define MAX_PRODUCERS 8
+#define LATENCY_BUCKETS 40
+#define VALIDATE_POSITIONS 512
+#define VALIDATE_ROUNDS 20
+
+typedef struct
+{
+    long count;
+    long buckets[LATENCY_BUCKETS]; // bucket n holds latencies below 2^n ns
+} LatencyHistogram;
+
+typedef struct
+{
+    void *queue;
+    int mpsc;
+    long events;
+    long pace_ns; // pause between pushes, 0 pushes as fast as the ring takes them
+    double push_ns;
+    long full;    // pushes retried because the ring was full
+} Producer;
+
+static double seconds_since(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void record_latency(LatencyHistogram *histogram, uint64_t ns)
+{
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && ns >= (1ULL << bucket))
+    {
+        bucket++;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+}
+
+// Upper bound of the bucket holding the given fraction of the samples
+static double latency_percentile(LatencyHistogram *histogram, double fraction)
+{
+    long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen >= histogram->count * fraction)
+        {
+            return (1ULL << bucket) / 1000.0;
+        }
+    }
+    return 0;
+}
+
+static void *produce(void *arg)
+{
+    Producer *producer = arg;
+    GameEvent event;
+    struct timespec start;
+
+    memset(&event, 0, sizeof(event));
+    event.type = EVENT_MOVE;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double paused = 0;
+    for (long i = 0; i < producer->events; i++)
+    {
+        if (producer->pace_ns > 0)
+        {
+            struct timespec pause = {0, producer->pace_ns};
+            struct timespec before;
+            clock_gettime(CLOCK_MONOTONIC, &before);
+            nanosleep(&pause, NULL);
+            paused += seconds_since(&before);
+        }
+        event.ply = i;
+        event.time_ns = event_clock_ns();
+        while ((producer->mpsc ? mpsc_push(producer->queue, &event) : spsc_push(producer->queue, &event)) < 0)
+        {
+            // Let the consumer run, on few cores spinning only burns its time
+            producer->full++;
+            sched_yield();
+        }
+    }
+    producer->push_ns = (seconds_since(&start) - paused) * 1e9 / producer->events;
+    return NULL;
+}
+
+// Producers push into one ring, the calling thread consumes in batches and
+// sleeps on the eventfd when the ring is empty
+static void run_ring(const char *name, int mpsc, int producers, long pace_ns)
+{
+    SpscQueue spsc;
+    MpscQueue mpsc_queue;
+    Producer workers[MAX_PRODUCERS];
+    pthread_t threads[MAX_PRODUCERS];
+    LatencyHistogram latency;
+    GameEvent batch[QUEUE_BATCH];
+    long events = pace_ns > 0 ? 20000 : QUEUE_EVENTS;
+    long total = events * producers;
+    long received = 0;
+    long waits = 0;
+
+    if ((mpsc ? mpsc_init(&mpsc_queue, QUEUE_CAPACITY) : spsc_init(&spsc, QUEUE_CAPACITY)) < 0)
+    {
+        perror("queue");
+        exit(1);
+    }
+    memset(&latency, 0, sizeof(latency));
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < producers; i++)
+    {
+        memset(&workers[i], 0, sizeof(workers[i]));
+        workers[i].queue = mpsc ? (void *)&mpsc_queue : (void *)&spsc;
+        workers[i].mpsc = mpsc;
+        workers[i].events = events;
+        workers[i].pace_ns = pace_ns;
+        pthread_create(&threads[i], NULL, produce, &workers[i]);
+    }
+
+    while (received < total)
+    {
+        int count = mpsc ? mpsc_pop_batch(&mpsc_queue, batch, QUEUE_BATCH) : spsc_pop_batch(&spsc, batch, QUEUE_BATCH);
+        if (count == 0)
+        {
+            waits++;
+            mpsc ? mpsc_wait(&mpsc_queue, 100) : spsc_wait(&spsc, 100);
+            continue;
+        }
+        uint64_t now = event_clock_ns();
+        for (int i = 0; i < count; i++)
+        {
+            record_latency(&latency, now - batch[i].time_ns);
+        }
+        received += count;
+    }
+    double seconds = seconds_since(&start);
+
+    double push_ns = 0;
+    long full = 0;
+    for (int i = 0; i < producers; i++)
+    {
+        pthread_join(threads[i], NULL);
+        push_ns += workers[i].push_ns / producers;
+        full += workers[i].full;
+    }
+    printf("%-28s %d producer%s: %6.1f ns per push, %6.1f M events/s, latency p50 %8.2f us p99 %8.2f us, "
+           "%ld waits, %ld full\n",
+           name, producers, producers > 1 ? "s" : " ", push_ns, total / seconds / 1e6,
+           latency_percentile(&latency, 0.5), latency_percentile(&latency, 0.99), waits, full);
+
+    mpsc ? mpsc_destroy(&mpsc_queue) : spsc_destroy(&spsc);
+}
+
+// Push and pop on one thread, the cost of the ring itself
+static void run_uncontended(void)
+{
+    SpscQueue queue;
+    GameEvent event;
+    GameEvent batch[QUEUE_BATCH];
+    struct timespec start;
+
+    spsc_init(&queue, QUEUE_CAPACITY);
+    memset(&event, 0, sizeof(event));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < QUEUE_EVENTS; i += QUEUE_BATCH)
+    {
+        for (int j = 0; j < QUEUE_BATCH; j++)
+        {
+            spsc_push(&queue, &event);
+        }
+        spsc_pop_batch(&queue, batch, QUEUE_BATCH);
+    }
+    printf("%-28s %6.1f ns per push and pop\n", "spsc, one thread", seconds_since(&start) * 1e9 / QUEUE_EVENTS);
+    spsc_destroy(&queue);
+}
+
+static void bench_queue(void)
+{
+    printf("== event rings, capacity %d, batches of %d\n", QUEUE_CAPACITY, QUEUE_BATCH);
+    run_uncontended();
+    run_ring("spsc, saturated", 0, 1, 0);
+    run_ring("spsc, one event per 20 us", 0, 1, 20000);
+    for (int producers = 1; producers <= 4; producers *= 2)
+    {
+        run_ring("mpsc, saturated", 1, producers, 0);
+    }
+    run_ring("mpsc, one event per 20 us", 1, 4, 20000);
+}
+
+// Play random legal moves from the starting position, a fixed seed keeps
+// the positions the same from run to run
+static void random_positions(ChessGame *positions, int count)
+{
+    unsigned int seed = 12345;
+    for (int i = 0; i < count; i++)
+    {
+        ChessGame *game = &positions[i];
+        memset(game, 0, sizeof(*game));
+        load_fen(game, START_FEN);
+
+        int plies = 10 + rand_r(&seed) % 60;
+        for (int ply = 0; ply < plies; ply++)
+        {
+            int isPlayerWhite = game->current_player == 1;
+            Move move;
+            int tries = 0;
+            do
+            {
+                int from = rand_r(&seed) % 64;
+                int to = rand_r(&seed) % 64;
+                move.from_row = from / 8;
+                move.from_col = from % 8;
+                move.to_row = to / 8;
+                move.to_col = to % 8;
+            } while (validate_move(game, &move, isPlayerWhite) != MOVE_VALID && ++tries < 100000);
+            if (tries == 100000)
+            {
+                break;
+            }
+            move_king(game, &move);
+            apply_move(&move, game->board);
+            game->current_player = isPlayerWhite ? 2 : 1;
+        }
+    }
+}
+
+// Every (own piece, target square) pair of every position, the loop the
+// engine's move generator runs
+static void run_validate(ChessGame *positions, const char *name, int full)
+{
+    struct timespec start;
+    long calls = 0;
+    long valid = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < VALIDATE_ROUNDS; round++)
+    {
+        for (int i = 0; i < VALIDATE_POSITIONS; i++)
+        {
+            ChessGame *game = &positions[i];
+            int isPlayerWhite = game->current_player == 1;
+            for (int from = 0; from < 64; from++)
+            {
+                char piece = game->board[from / 8][from % 8];
+                if (piece == '.' || (piece < 96) != isPlayerWhite)
+                {
+                    continue;
+                }
+                for (int to = 0; to < 64; to++)
+                {
+                    Move move;
+                    move.from_row = from / 8;
+                    move.from_col = from % 8;
+                    move.to_row = to / 8;
+                    move.to_col = to % 8;
+                    MoveStatus status = full ? validate_move(game, &move, isPlayerWhite)
+                                             : check_move_pattern(game->board, &move, isPlayerWhite);
+                    valid += status == MOVE_VALID;
+                    calls++;
+                }
+            }
+        }
+    }
+    printf("%-28s %6.1f ns per call, %ld calls, %ld valid\n", name, seconds_since(&start) * 1e9 / calls, calls, valid);
+}
+
+static void run_attacked(ChessGame *positions)
+{
+    for (AttackBackend attack = ATTACK_SCALAR; attack <= ATTACK_AVX2; attack++)
+    {
+        struct timespec start;
+        long attacked = 0;
+        char name[64];
+
+        if (set_attack_backend(attack) != 0)
+        {
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int round = 0; round < VALIDATE_ROUNDS; round++)
+        {
+            for (int i = 0; i < VALIDATE_POSITIONS; i++)
+            {
+                for (int square = 0; square < 64; square++)
+                {
+                    Tile tile = {square / 8, square % 8};
+                    attacked += is_tile_attacked(positions[i].board, &tile, square & 1);
+                }
+            }
+        }
+        long calls = (long)VALIDATE_ROUNDS * VALIDATE_POSITIONS * 64;
+        snprintf(name, sizeof(name), "is_tile_attacked, %s", attack_backend_name(attack));
+        printf("%-28s %6.1f ns per call, %ld attacked\n", name, seconds_since(&start) * 1e9 / calls, attacked);
+    }
+}
+
+static void bench_validate(void)
+{
+    ChessGame *positions = malloc(sizeof(ChessGame) * VALIDATE_POSITIONS);
+    if (positions == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    random_positions(positions, VALIDATE_POSITIONS);
+
+    AttackBackend fastest = get_attack_backend();
+    printf("== move validation, %d positions from random games\n", VALIDATE_POSITIONS);
+    run_validate(positions, "check_move_pattern", 0);
+    run_attacked(positions);
+    set_attack_backend(fastest);
+    run_validate(positions, "validate_move", 1);
+    free(positions);
+}
+
+int main(int argc, char **argv)
+{
+    int queue = argc < 2;
+    int validate = argc < 2;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "queue") == 0)
+        {
+            queue = 1;
+        }
+        else if (strcmp(argv[i], "validate") == 0)
+        {
+            validate = 1;
+        }
+        else
+        {
+            printf("usage: %s [queue] [validate]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (queue)
+    {
+        bench_queue();
+    }
+    if (validate)
+    {
+        bench_validate();
+    }
+    return 0;
+}
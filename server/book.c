@@ -0,0 +1,248 @@
+#include "book.h"
+#include "history.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Zobrist keys, generated from a fixed seed so every build hashes the same
+// position to the same key and book files stay valid
+static uint64_t piece_keys[12][64];
+static uint64_t castling_keys[16];
+static uint64_t en_passant_keys[8];
+static uint64_t black_to_move_key;
+
+static const char zobrist_pieces[] = "PNBRQKpnbrqk";
+
+static uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+__attribute__((constructor)) static void init_zobrist_keys(void)
+{
+    uint64_t state = 0x43484b5a4f425249ULL;
+    for (int piece = 0; piece < 12; piece++)
+    {
+        for (int square = 0; square < 64; square++)
+        {
+            piece_keys[piece][square] = splitmix64(&state);
+        }
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        castling_keys[i] = splitmix64(&state);
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        en_passant_keys[i] = splitmix64(&state);
+    }
+    black_to_move_key = splitmix64(&state);
+}
+
+// Hash of the pieces, the side to move, castling rights and en passant file
+uint64_t position_hash(ChessGame *game)
+{
+    uint64_t hash = 0;
+    for (int square = 0; square < 64; square++)
+    {
+        char piece = game->board[square / 8][square % 8];
+        if (piece == '.')
+        {
+            continue;
+        }
+        const char *index = strchr(zobrist_pieces, piece);
+        if (index != NULL)
+        {
+            hash ^= piece_keys[index - zobrist_pieces][square];
+        }
+    }
+    hash ^= castling_keys[game->castling & 15];
+    if (game->en_passant.row >= 0)
+    {
+        hash ^= en_passant_keys[game->en_passant.col & 7];
+    }
+    if (game->current_player == 2)
+    {
+        hash ^= black_to_move_key;
+    }
+    return hash;
+}
+
+// Map the book file, returns 0 on success and -1 when it can not be used
+int book_open(Book *book, const char *path)
+{
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("book open");
+        return -1;
+    }
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(BookHeader))
+    {
+        printf("Book %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("book mmap");
+        return -1;
+    }
+
+    const BookHeader *header = map;
+    if (header->magic != BOOK_MAGIC || header->version != BOOK_VERSION ||
+        header->count != (info.st_size - sizeof(BookHeader)) / sizeof(BookEntry) ||
+        (info.st_size - sizeof(BookHeader)) % sizeof(BookEntry) != 0)
+    {
+        printf("Book %s is not a book file of this version\n", path);
+        munmap(map, info.st_size);
+        return -1;
+    }
+
+    // Lookups jump around the file, read ahead would only waste the cache
+    madvise(map, info.st_size, MADV_RANDOM);
+    book->map = map;
+    book->size = info.st_size;
+    book->entries = (const BookEntry *)((const char *)map + sizeof(BookHeader));
+    book->count = header->count;
+    return 0;
+}
+
+void book_close(Book *book)
+{
+    if (book->map != NULL)
+    {
+        munmap(book->map, book->size);
+    }
+    memset(book, 0, sizeof(*book));
+}
+
+// Entries of the position, NULL when it is not in the book.
+// The keys are uniformly spread hashes, so the search first guesses the
+// position from the key value and falls back to halving if that keeps missing.
+const BookEntry *book_find(Book *book, uint64_t key, int *count)
+{
+    const BookEntry *entries = book->entries;
+    *count = 0;
+    if (book->count == 0)
+    {
+        return NULL;
+    }
+
+    uint64_t low = 0;
+    uint64_t high = book->count - 1;
+    int probes = 0;
+    while (low <= high && key >= entries[low].key && key <= entries[high].key)
+    {
+        uint64_t pos;
+        if (probes++ < 8 && entries[high].key != entries[low].key)
+        {
+            pos = low + (uint64_t)((unsigned __int128)(key - entries[low].key) * (high - low) /
+                                   (entries[high].key - entries[low].key));
+        }
+        else
+        {
+            pos = low + (high - low) / 2;
+        }
+
+        if (entries[pos].key < key)
+        {
+            low = pos + 1;
+        }
+        else if (entries[pos].key > key)
+        {
+            if (pos == 0)
+            {
+                break;
+            }
+            high = pos - 1;
+        }
+        else
+        {
+            uint64_t first = pos;
+            uint64_t last = pos;
+            while (first > 0 && entries[first - 1].key == key)
+            {
+                first--;
+            }
+            while (last + 1 < book->count && entries[last + 1].key == key)
+            {
+                last++;
+            }
+            *count = last - first + 1;
+            return &entries[first];
+        }
+    }
+    return NULL;
+}
+
+static int same_squares(PackedMove packed, Move *move)
+{
+    Move book_move = unpack_move(packed);
+    return book_move.from_row == move->from_row && book_move.from_col == move->from_col &&
+           book_move.to_row == move->to_row && book_move.to_col == move->to_col;
+}
+
+// Returns 1 when the move is a book move in the game's current position
+int book_contains(Book *book, ChessGame *game, Move *move)
+{
+    int count;
+    const BookEntry *entries = book_find(book, position_hash(game), &count);
+    for (int i = 0; i < count; i++)
+    {
+        if (same_squares(entries[i].move, move))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Weight of a book move, 0 for moves the rules reject
+static long entry_weight(ChessGame *game, const BookEntry *entry, int isPlayerWhite)
+{
+    Move candidate = unpack_move(entry->move);
+    return validate_move(game, &candidate, isPlayerWhite) == MOVE_VALID ? entry->weight + 1 : 0;
+}
+
+// Pick a book move for the side to move, more popular moves more often.
+// Moves the rules reject, which only a hash collision can produce, are
+// skipped. The count comes from the book file, so the entries are walked
+// twice instead of buffering their weights. Returns 0 when the position is
+// out of book.
+int book_choose(Book *book, ChessGame *game, Move *move)
+{
+    int count;
+    int isPlayerWhite = game->current_player == 1;
+    const BookEntry *entries = book_find(book, position_hash(game), &count);
+    long total = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        total += entry_weight(game, &entries[i], isPlayerWhite);
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    long pick = rand() % total;
+    for (int i = 0; i < count; i++)
+    {
+        long weight = entry_weight(game, &entries[i], isPlayerWhite);
+        if (pick < weight)
+        {
+            *move = unpack_move(entries[i].move);
+            return 1;
+        }
+        pick -= weight;
+    }
+    return 0;
+}
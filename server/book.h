@@ -0,0 +1,42 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include "utils.h"
+
+// Opening book file: a header followed by entries sorted by position hash.
+// The file is mapped read only, so opening it costs the same for any size
+// and every process using the book shares the page cache.
+
+#define BOOK_MAGIC 0x4b424843 // "CHBK"
+#define BOOK_VERSION 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+} BookHeader;
+
+typedef struct
+{
+    uint64_t key;       // position_hash of the position before the move
+    PackedMove move;
+    uint16_t weight;    // how often the move was played, higher is picked more
+    uint32_t reserved;
+} BookEntry;
+
+typedef struct
+{
+    void *map;
+    size_t size;
+    const BookEntry *entries;
+    uint64_t count;
+} Book;
+
+uint64_t position_hash(ChessGame *game);
+int book_open(Book *book, const char *path);
+void book_close(Book *book);
+const BookEntry *book_find(Book *book, uint64_t key, int *count);
+int book_contains(Book *book, ChessGame *game, Move *move);
+int book_choose(Book *book, ChessGame *game, Move *move);
+#endif // BOOK_H
@@ -0,0 +1,350 @@
+#include "engine.h"
+#include "pool.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Alpha-beta search over the server's own move rules, so the engine never
+// plays a move the server would reject
+
+typedef struct
+{
+    ChessGame position;
+    unsigned int ticket;
+    SearchLimits limits;
+} SearchJob;
+
+typedef struct
+{
+    SearchLimits *limits;
+    struct timespec start;
+    long nodes;
+    int aborted;
+} SearchState;
+
+static int result_pipe[2] = {-1, -1};
+static atomic_int engine_stopping;
+
+static int piece_value(char piece)
+{
+    switch (tolower(piece))
+    {
+    case 'p':
+        return 100;
+    case 'n':
+        return 320;
+    case 'b':
+        return 330;
+    case 'r':
+        return 500;
+    case 'q':
+        return 900;
+    case 'k':
+        return 20000;
+    default:
+        return 0;
+    }
+}
+
+static double elapsed_since(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static int out_of_budget(SearchState *state)
+{
+    if (atomic_load(&engine_stopping))
+    {
+        return 1;
+    }
+    if (state->limits->max_nodes > 0 && state->nodes >= state->limits->max_nodes)
+    {
+        return 1;
+    }
+    return elapsed_since(&state->start) >= state->limits->time_ms;
+}
+
+// Material balance from the point of view of the given side
+int evaluate(ChessGame *game, int isPlayerWhite)
+{
+    int score = 0;
+    for (int row = 0; row < 8; row++)
+    {
+        for (int col = 0; col < 8; col++)
+        {
+            char piece = game->board[row][col];
+            if (piece == '.')
+            {
+                continue;
+            }
+            score += piece < 96 ? piece_value(piece) : -piece_value(piece);
+        }
+    }
+    return isPlayerWhite ? score : -score;
+}
+
+// All moves validate_move accepts, captures first and the biggest victims first
+int generate_moves(ChessGame *game, int isPlayerWhite, Move *moves)
+{
+    int count = 0;
+    int captures = 0;
+
+    for (int from = 0; from < 64; from++)
+    {
+        char piece = game->board[from / 8][from % 8];
+        if (piece == '.' || (piece < 96) != isPlayerWhite)
+        {
+            continue;
+        }
+
+        for (int to = 0; to < 64 && count < MAX_MOVES; to++)
+        {
+            Move move;
+            move.from_row = from / 8;
+            move.from_col = from % 8;
+            move.to_row = to / 8;
+            move.to_col = to % 8;
+            if (validate_move(game, &move, isPlayerWhite) != MOVE_VALID)
+            {
+                continue;
+            }
+
+            moves[count] = move;
+            if (game->board[move.to_row][move.to_col] != '.')
+            {
+                // Insertion sort of the captures at the front of the list
+                int value = piece_value(game->board[move.to_row][move.to_col]);
+                int pos = captures;
+                moves[count] = moves[captures];
+                while (pos > 0 && piece_value(game->board[moves[pos - 1].to_row][moves[pos - 1].to_col]) < value)
+                {
+                    moves[pos] = moves[pos - 1];
+                    pos--;
+                }
+                moves[pos] = move;
+                captures++;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+static char play(ChessGame *game, Move *move)
+{
+    move_king(game, move);
+    return apply_move(move, game->board);
+}
+
+static void undo(ChessGame *game, Move *move, char piece_taken, Tile white_king, Tile black_king)
+{
+    revert_move(move, game->board, piece_taken);
+    game->white_king = white_king;
+    game->black_king = black_king;
+}
+
+static int negamax(ChessGame *game, int depth, int alpha, int beta, int isPlayerWhite, int ply, SearchState *state)
+{
+    state->nodes++;
+    if ((state->nodes & 1023) == 0 && out_of_budget(state))
+    {
+        state->aborted = 1;
+    }
+    if (state->aborted)
+    {
+        return 0;
+    }
+
+    // The rules allow taking the king, losing it ends the line
+    Tile king = isPlayerWhite ? game->white_king : game->black_king;
+    if (game->board[king.row][king.col] != (isPlayerWhite ? 'K' : 'k'))
+    {
+        return -MATE_SCORE + ply;
+    }
+
+    if (depth == 0)
+    {
+        return evaluate(game, isPlayerWhite);
+    }
+
+    Move moves[MAX_MOVES];
+    int count = generate_moves(game, isPlayerWhite, moves);
+    if (count == 0)
+    {
+        return is_king_checked(game, isPlayerWhite) ? -MATE_SCORE + ply : 0;
+    }
+
+    int best = -MATE_SCORE - 1;
+    for (int i = 0; i < count; i++)
+    {
+        Tile white_king = game->white_king;
+        Tile black_king = game->black_king;
+        char piece_taken = play(game, &moves[i]);
+        int score = -negamax(game, depth - 1, -beta, -alpha, !isPlayerWhite, ply + 1, state);
+        undo(game, &moves[i], piece_taken, white_king, black_king);
+
+        if (state->aborted)
+        {
+            return 0;
+        }
+        if (score > best)
+        {
+            best = score;
+        }
+        if (score > alpha)
+        {
+            alpha = score;
+        }
+        if (alpha >= beta)
+        {
+            break;
+        }
+    }
+    return best;
+}
+
+// Iterative deepening until the time or node budget runs out, the move of
+// the last fully searched depth is returned
+SearchResult search_best_move(ChessGame *game, SearchLimits *limits)
+{
+    SearchResult result;
+    SearchState state;
+    ChessGame position = *game;
+    int isPlayerWhite = game->current_player == 1;
+    Move moves[MAX_MOVES];
+
+    memset(&result, 0, sizeof(result));
+    state.limits = limits;
+    state.nodes = 0;
+    state.aborted = 0;
+    clock_gettime(CLOCK_MONOTONIC, &state.start);
+
+    int count = generate_moves(&position, isPlayerWhite, moves);
+    if (count == 0)
+    {
+        result.elapsed_ms = elapsed_since(&state.start);
+        return result;
+    }
+    result.found = 1;
+    result.move = moves[0];
+
+    for (int depth = 1; depth <= MAX_SEARCH_DEPTH; depth++)
+    {
+        int alpha = -MATE_SCORE - 1;
+        int best_index = 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            Tile white_king = position.white_king;
+            Tile black_king = position.black_king;
+            char piece_taken = play(&position, &moves[i]);
+            int score = -negamax(&position, depth - 1, -MATE_SCORE - 1, -alpha, !isPlayerWhite, 1, &state);
+            undo(&position, &moves[i], piece_taken, white_king, black_king);
+
+            if (state.aborted)
+            {
+                break;
+            }
+            if (score > alpha)
+            {
+                alpha = score;
+                best_index = i;
+            }
+        }
+
+        if (state.aborted)
+        {
+            break;
+        }
+
+        result.move = moves[best_index];
+        result.score = alpha;
+        result.depth = depth;
+
+        // Search the best move first at the next depth
+        Move best = moves[best_index];
+        for (int i = best_index; i > 0; i--)
+        {
+            moves[i] = moves[i - 1];
+        }
+        moves[0] = best;
+
+        if (alpha >= MATE_SCORE - MAX_SEARCH_DEPTH || out_of_budget(&state))
+        {
+            break;
+        }
+    }
+
+    result.nodes = state.nodes;
+    result.elapsed_ms = elapsed_since(&state.start);
+    return result;
+}
+
+static void run_search(void *arg)
+{
+    SearchJob *job = (SearchJob *)arg;
+    SearchResult result = search_best_move(&job->position, &job->limits);
+    result.game_id = job->position.game_id;
+    result.ticket = job->ticket;
+
+    // Smaller than PIPE_BUF, so results of different workers never interleave
+    if (write(result_pipe[1], &result, sizeof(result)) != sizeof(result))
+    {
+        perror("engine result");
+    }
+    free(job);
+}
+
+// Returns the descriptor search results are read from, the worker pool
+// must be running
+int engine_start(void)
+{
+    if (pipe(result_pipe) < 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+    fcntl(result_pipe[0], F_SETFL, fcntl(result_pipe[0], F_GETFL) | O_NONBLOCK);
+    return result_pipe[0];
+}
+
+// Queue a search of the game's current position, returns -1 when the queue is full
+int engine_request(ChessGame *game, unsigned int ticket, SearchLimits *limits)
+{
+    SearchJob *job = malloc(sizeof(SearchJob));
+    if (job == NULL)
+    {
+        return -1;
+    }
+    job->position = *game;
+    job->ticket = ticket;
+    job->limits = *limits;
+
+    if (pool_submit(run_search, job) < 0)
+    {
+        free(job);
+        return -1;
+    }
+    return 0;
+}
+
+// Returns 1 when a finished search was read
+int engine_read_result(SearchResult *result)
+{
+    return read(result_pipe[0], result, sizeof(SearchResult)) == sizeof(SearchResult);
+}
+
+// Make the running and queued searches return right away
+void engine_abort(void)
+{
+    atomic_store(&engine_stopping, 1);
+}
+
+// Called after the workers were joined
+void engine_stop(void)
+{
+    close(result_pipe[0]);
+    close(result_pipe[1]);
+}
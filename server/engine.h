@@ -0,0 +1,36 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "utils.h"
+
+#define MAX_MOVES 256
+#define MAX_SEARCH_DEPTH 32
+#define MATE_SCORE 100000
+
+typedef struct
+{
+    int time_ms;   // time budget of one move
+    long max_nodes; // node budget of one move, 0 for no limit
+} SearchLimits;
+
+typedef struct
+{
+    int game_id;
+    unsigned int ticket; // matches the request, stale answers are dropped
+    int found;           // 0 when the side to move has no legal move
+    Move move;
+    int score;
+    int depth;
+    long nodes;
+    double elapsed_ms;
+} SearchResult;
+
+int generate_moves(ChessGame *game, int isPlayerWhite, Move *moves);
+int evaluate(ChessGame *game, int isPlayerWhite);
+SearchResult search_best_move(ChessGame *game, SearchLimits *limits);
+int engine_start(void);
+int engine_request(ChessGame *game, unsigned int ticket, SearchLimits *limits);
+int engine_read_result(SearchResult *result);
+void engine_abort(void);
+void engine_stop(void);
+#endif // ENGINE_H
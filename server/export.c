@@ -0,0 +1,91 @@
+#include "export.h"
+#include "history.h"
+#include "pool.h"
+#include <fcntl.h>
+
+typedef struct
+{
+    ChessGame game; // its history is a snapshot owned by the job
+    int socket;
+    const char *white;
+    const char *black;
+} ExportJob;
+
+static int result_pipe[2] = {-1, -1};
+
+static void run_export(void *arg)
+{
+    ExportJob *job = (ExportJob *)arg;
+    ExportResult result;
+    result.game_id = job->game.game_id;
+    result.socket = job->socket;
+    result.pgn = history_export_pgn(&job->game, job->game.start_fen, job->white, job->black);
+
+    // Smaller than PIPE_BUF, so results of different workers never interleave
+    if (write(result_pipe[1], &result, sizeof(result)) != sizeof(result))
+    {
+        perror("export result");
+        free(result.pgn);
+    }
+    history_free_snapshot(&job->game.history);
+    free(job);
+}
+
+// Returns the descriptor finished exports are read from, the worker pool
+// must be running
+int export_start(void)
+{
+    if (pipe(result_pipe) < 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+    fcntl(result_pipe[0], F_SETFL, fcntl(result_pipe[0], F_GETFL) | O_NONBLOCK);
+    return result_pipe[0];
+}
+
+// Queue an export of the moves played so far, returns -1 when the queue is
+// full or out of memory. The player names must outlive the export.
+int export_request(ChessGame *game, int socket, const char *white, const char *black)
+{
+    ExportJob *job = malloc(sizeof(ExportJob));
+    if (job == NULL)
+    {
+        return -1;
+    }
+    job->game = *game;
+    job->socket = socket;
+    job->white = white;
+    job->black = black;
+    if (history_snapshot(&game->history, &job->game.history) < 0)
+    {
+        free(job);
+        return -1;
+    }
+
+    if (pool_submit(run_export, job) < 0)
+    {
+        history_free_snapshot(&job->game.history);
+        free(job);
+        return -1;
+    }
+    return 0;
+}
+
+// Returns 1 when a finished export was read
+int export_read_result(ExportResult *result)
+{
+    return read(result_pipe[0], result, sizeof(ExportResult)) == sizeof(ExportResult);
+}
+
+// Called after the workers were joined, exports nobody read are freed
+void export_stop(void)
+{
+    ExportResult result;
+    while (export_read_result(&result))
+    {
+        free(result.pgn);
+    }
+    close(result_pipe[0]);
+    close(result_pipe[1]);
+}
@@ -0,0 +1,20 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "utils.h"
+
+// PGN exports run on the worker pool: the network loop snapshots the game,
+// a worker replays it and the text comes back through a pipe to be sent
+
+typedef struct
+{
+    int game_id;
+    int socket; // player who asked, checked against the game before sending
+    char *pgn;  // malloc'ed, NULL when the export failed
+} ExportResult;
+
+int export_start(void);
+int export_request(ChessGame *game, int socket, const char *white, const char *black);
+int export_read_result(ExportResult *result);
+void export_stop(void);
+#endif // EXPORT_H
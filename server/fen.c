@@ -0,0 +1,335 @@
+#include "fen.h"
+
+// Castling rights lost when something moves from or to the given square
+static int castling_mask(int row, int col)
+{
+    if (row == 7 && col == 4)
+        return CASTLE_WHITE_KING | CASTLE_WHITE_QUEEN;
+    if (row == 7 && col == 7)
+        return CASTLE_WHITE_KING;
+    if (row == 7 && col == 0)
+        return CASTLE_WHITE_QUEEN;
+    if (row == 0 && col == 4)
+        return CASTLE_BLACK_KING | CASTLE_BLACK_QUEEN;
+    if (row == 0 && col == 7)
+        return CASTLE_BLACK_KING;
+    if (row == 0 && col == 0)
+        return CASTLE_BLACK_QUEEN;
+    return 0;
+}
+
+static int is_fen_piece(char c)
+{
+    switch (c)
+    {
+    case 'k': case 'q': case 'r': case 'b': case 'n': case 'p':
+    case 'K': case 'Q': case 'R': case 'B': case 'N': case 'P':
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Read a non-negative number, returns -1 when there are no digits
+static int parse_number(const char **cursor)
+{
+    const char *c = *cursor;
+    int value = 0;
+    if (!isdigit((unsigned char)*c))
+    {
+        return -1;
+    }
+    while (isdigit((unsigned char)*c) && value < 1000000)
+    {
+        value = value * 10 + (*c - '0');
+        c++;
+    }
+    *cursor = c;
+    return value;
+}
+
+// Set up the game from a FEN string, returns 0 on success and -1 when the
+// FEN is malformed, in which case the game is left unchanged.
+// The clocks are optional and default to "0 1".
+int load_fen(ChessGame *game, const char *fen)
+{
+    char board[8][8];
+    const char *c = fen;
+    int white_kings = 0;
+    int black_kings = 0;
+    Tile white_king = {0, 0};
+    Tile black_king = {0, 0};
+
+    // Piece placement, row 8 first
+    for (int row = 0; row < 8; row++)
+    {
+        int col = 0;
+        while (col < 8)
+        {
+            if (*c >= '1' && *c <= '8')
+            {
+                int empty = *c - '0';
+                if (col + empty > 8)
+                {
+                    return -1;
+                }
+                memset(&board[row][col], '.', empty);
+                col += empty;
+            }
+            else if (is_fen_piece(*c))
+            {
+                if (*c == 'K')
+                {
+                    white_king.row = row;
+                    white_king.col = col;
+                    white_kings++;
+                }
+                if (*c == 'k')
+                {
+                    black_king.row = row;
+                    black_king.col = col;
+                    black_kings++;
+                }
+                board[row][col++] = *c;
+            }
+            else
+            {
+                return -1;
+            }
+            c++;
+        }
+        if (row < 7 && *c++ != '/')
+        {
+            return -1;
+        }
+    }
+
+    // The check detection needs exactly one king of each color
+    if (white_kings != 1 || black_kings != 1)
+    {
+        return -1;
+    }
+
+    // Side to move
+    if (*c++ != ' ' || (*c != 'w' && *c != 'b'))
+    {
+        return -1;
+    }
+    int current_player = *c++ == 'w' ? 1 : 2;
+
+    // Castling rights
+    if (*c++ != ' ')
+    {
+        return -1;
+    }
+    int castling = 0;
+    if (*c == '-')
+    {
+        c++;
+    }
+    else
+    {
+        while (*c != ' ' && *c != '\0')
+        {
+            switch (*c++)
+            {
+            case 'K':
+                castling |= CASTLE_WHITE_KING;
+                break;
+            case 'Q':
+                castling |= CASTLE_WHITE_QUEEN;
+                break;
+            case 'k':
+                castling |= CASTLE_BLACK_KING;
+                break;
+            case 'q':
+                castling |= CASTLE_BLACK_QUEEN;
+                break;
+            default:
+                return -1;
+            }
+        }
+        if (castling == 0)
+        {
+            return -1;
+        }
+    }
+
+    // En passant square
+    if (*c++ != ' ')
+    {
+        return -1;
+    }
+    Tile en_passant = {-1, -1};
+    if (*c == '-')
+    {
+        c++;
+    }
+    else
+    {
+        if (c[0] < 'a' || c[0] > 'h' || (c[1] != '3' && c[1] != '6'))
+        {
+            return -1;
+        }
+        en_passant.col = c[0] - 'a';
+        en_passant.row = '8' - c[1];
+        c += 2;
+    }
+
+    // Halfmove clock and fullmove number
+    int halfmove_clock = 0;
+    int fullmove = 1;
+    if (*c == ' ')
+    {
+        c++;
+        halfmove_clock = parse_number(&c);
+        if (halfmove_clock < 0 || *c++ != ' ')
+        {
+            return -1;
+        }
+        fullmove = parse_number(&c);
+        if (fullmove < 1)
+        {
+            return -1;
+        }
+    }
+    while (*c == ' ' || *c == '\n' || *c == '\r')
+    {
+        c++;
+    }
+    if (*c != '\0')
+    {
+        return -1;
+    }
+
+    memcpy(game->board, board, sizeof(board));
+    game->current_player = current_player;
+    game->turn = fullmove;
+    game->white_king = white_king;
+    game->black_king = black_king;
+    game->white_checked = 0;
+    game->black_checked = 0;
+    game->castling = castling;
+    game->en_passant = en_passant;
+    game->halfmove_clock = halfmove_clock;
+    return 0;
+}
+
+// Copy the part of a game load_fen sets, so a position parsed once can
+// start any number of games
+void copy_position(ChessGame *game, const ChessGame *position)
+{
+    memcpy(game->board, position->board, sizeof(game->board));
+    game->current_player = position->current_player;
+    game->turn = position->turn;
+    game->white_king = position->white_king;
+    game->black_king = position->black_king;
+    game->white_checked = position->white_checked;
+    game->black_checked = position->black_checked;
+    game->castling = position->castling;
+    game->en_passant = position->en_passant;
+    game->halfmove_clock = position->halfmove_clock;
+}
+
+// Write the game as FEN, returns the length or -1 when the buffer is too small
+int write_fen(ChessGame *game, char *fen, size_t size)
+{
+    char buffer[FEN_MAX_LENGTH];
+    int pos = 0;
+
+    for (int row = 0; row < 8; row++)
+    {
+        int empty = 0;
+        for (int col = 0; col < 8; col++)
+        {
+            char piece = game->board[row][col];
+            if (piece == '.')
+            {
+                empty++;
+                continue;
+            }
+            if (empty > 0)
+            {
+                buffer[pos++] = '0' + empty;
+                empty = 0;
+            }
+            buffer[pos++] = piece;
+        }
+        if (empty > 0)
+        {
+            buffer[pos++] = '0' + empty;
+        }
+        buffer[pos++] = row < 7 ? '/' : ' ';
+    }
+
+    buffer[pos++] = game->current_player == 1 ? 'w' : 'b';
+    buffer[pos++] = ' ';
+
+    if (game->castling == 0)
+    {
+        buffer[pos++] = '-';
+    }
+    if (game->castling & CASTLE_WHITE_KING)
+        buffer[pos++] = 'K';
+    if (game->castling & CASTLE_WHITE_QUEEN)
+        buffer[pos++] = 'Q';
+    if (game->castling & CASTLE_BLACK_KING)
+        buffer[pos++] = 'k';
+    if (game->castling & CASTLE_BLACK_QUEEN)
+        buffer[pos++] = 'q';
+    buffer[pos++] = ' ';
+
+    if (game->en_passant.row < 0)
+    {
+        buffer[pos++] = '-';
+    }
+    else
+    {
+        buffer[pos++] = 'a' + game->en_passant.col;
+        buffer[pos++] = '8' - game->en_passant.row;
+    }
+
+    pos += snprintf(buffer + pos, FEN_MAX_LENGTH - pos, " %d %d", game->halfmove_clock, game->turn);
+
+    if ((size_t)pos >= size)
+    {
+        return -1;
+    }
+    memcpy(fen, buffer, pos);
+    fen[pos] = '\0';
+    return pos;
+}
+
+// Update castling rights, en passant square and clocks after a move was played
+void update_position_state(ChessGame *game, Move *move, char piece, char piece_taken)
+{
+    game->castling &= ~(castling_mask(move->from_row, move->from_col) |
+                        castling_mask(move->to_row, move->to_col));
+
+    int is_pawn = tolower(piece) == 'p';
+    if (is_pawn && abs(move->from_row - move->to_row) == 2)
+    {
+        game->en_passant.row = (move->from_row + move->to_row) / 2;
+        game->en_passant.col = move->from_col;
+    }
+    else
+    {
+        game->en_passant.row = -1;
+        game->en_passant.col = -1;
+    }
+
+    if (is_pawn || piece_taken != '.')
+    {
+        game->halfmove_clock = 0;
+    }
+    else
+    {
+        game->halfmove_clock++;
+    }
+
+    // Fullmove number goes up after black's move
+    if (piece > 96)
+    {
+        game->turn++;
+    }
+}
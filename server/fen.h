@@ -0,0 +1,17 @@
+#ifndef FEN_H
+#define FEN_H
+
+#include "utils.h"
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+#define CASTLE_WHITE_KING 1
+#define CASTLE_WHITE_QUEEN 2
+#define CASTLE_BLACK_KING 4
+#define CASTLE_BLACK_QUEEN 8
+
+int load_fen(ChessGame *game, const char *fen);
+void copy_position(ChessGame *game, const ChessGame *position);
+int write_fen(ChessGame *game, char *fen, size_t size);
+void update_position_state(ChessGame *game, Move *move, char piece, char piece_taken);
+#endif // FEN_H
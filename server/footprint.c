@@ -0,0 +1,97 @@
+#include "footprint.h"
+#include "history.h"
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <linux/sockios.h>
+
+static void add_connection(GameFootprint *footprint, int socket)
+{
+    int receive_size = 0;
+    int send_size = 0;
+    int queued_in = 0;
+    int queued_out = 0;
+    socklen_t length = sizeof(int);
+
+    // The engine seat has no socket
+    if (socket < 0)
+    {
+        return;
+    }
+    footprint->connections++;
+    if (getsockopt(socket, SOL_SOCKET, SO_RCVBUF, &receive_size, &length) == 0 &&
+        getsockopt(socket, SOL_SOCKET, SO_SNDBUF, &send_size, &length) == 0)
+    {
+        footprint->socket_buffer_bytes += receive_size + send_size;
+    }
+    if (ioctl(socket, SIOCINQ, &queued_in) == 0 && ioctl(socket, SIOCOUTQ, &queued_out) == 0)
+    {
+        footprint->queued_bytes += queued_in + queued_out;
+    }
+}
+
+// Walk the games, their histories and their sockets
+void game_footprint(GameManager *gm, GameFootprint *footprint)
+{
+    memset(footprint, 0, sizeof(*footprint));
+    footprint->game_slots = MAX_GAMES;
+    footprint->game_bytes = sizeof(GameManager);
+    footprint->pool_chunks = history_pool_chunks();
+    footprint->history_bytes = footprint->pool_chunks * sizeof(HistoryChunk);
+
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        ChessGame *game = &gm->games[i];
+        if (!game->is_active)
+        {
+            continue;
+        }
+        footprint->active_games++;
+        footprint->history_chunks += (game->history.count + HISTORY_CHUNK_MOVES - 1) / HISTORY_CHUNK_MOVES;
+        add_connection(footprint, game->player1_socket);
+        add_connection(footprint, game->player2_socket);
+    }
+}
+
+// Server memory of one game between moves: its slot and the history chunks
+// an average active game holds. Kernel socket buffers are not included.
+size_t idle_game_bytes(GameFootprint *footprint)
+{
+    size_t bytes = footprint->game_bytes / footprint->game_slots;
+    if (footprint->active_games > 0)
+    {
+        bytes += footprint->history_chunks * sizeof(HistoryChunk) / footprint->active_games;
+    }
+    return bytes;
+}
+
+// Returns -1 when the resident size could not be read
+int process_footprint(ProcessFootprint *footprint)
+{
+    struct rusage usage;
+    struct mallinfo2 heap = mallinfo2();
+    long pages = 0;
+
+    memset(footprint, 0, sizeof(*footprint));
+    footprint->heap_bytes = heap.arena + heap.hblkhd;
+    footprint->heap_in_use = heap.uordblks + heap.hblkhd;
+    footprint->heap_free = heap.fordblks;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        footprint->peak_rss_bytes = (size_t)usage.ru_maxrss * 1024;
+    }
+
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+    {
+        return -1;
+    }
+    int read = fscanf(statm, "%*d %ld", &pages);
+    fclose(statm);
+    if (read != 1)
+    {
+        return -1;
+    }
+    footprint->rss_bytes = (size_t)pages * sysconf(_SC_PAGESIZE);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include "utils.h"
+
+// What the games and their connections cost, counted from the GameManager,
+// and what the process holds according to the kernel and the allocator
+
+typedef struct
+{
+    long game_slots;            // games the manager holds, active or not
+    long active_games;
+    size_t game_bytes;          // the GameManager itself
+    long history_chunks;        // chunks held by active games
+    long pool_chunks;           // chunks the history pool took from malloc
+    size_t history_bytes;       // memory of all pool chunks
+    long connections;
+    size_t socket_buffer_bytes; // kernel send and receive buffer limits
+    size_t queued_bytes;        // bytes waiting in those buffers
+} GameFootprint;
+
+typedef struct
+{
+    size_t rss_bytes;
+    size_t peak_rss_bytes;
+    size_t heap_bytes;  // taken from the system by malloc, mmapped blocks included
+    size_t heap_in_use; // handed out by malloc
+    size_t heap_free;   // free inside the heap
+} ProcessFootprint;
+
+void game_footprint(GameManager *gm, GameFootprint *footprint);
+size_t idle_game_bytes(GameFootprint *footprint);
+int process_footprint(ProcessFootprint *footprint);
+#endif // FOOTPRINT_H
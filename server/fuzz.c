@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "utils.h"
+#include "attack.h"
+#include "engine.h"
+
+// Fuzz target for the rule code. Built with clang -fsanitize=fuzzer and
+// -DFUZZ_LIBFUZZER it is a libFuzzer target, otherwise main() below runs the
+// files given on the command line (for AFL: afl-fuzz -i in -o out ./fuzz @@)
+// or random inputs for a while.
+//
+// usage: fuzz [-t SECONDS] [-s SEED] [FILE...]
+//
+// Input layout:
+//   64 bytes  board squares, row 8 first, each byte picks a piece or empty
+//   1 byte    side to move, odd for black
+//   4 bytes   per move, passed to convert as they are
+//
+// Every input is checked against a reference written from the rules rather
+// than from the optimized code: the attack queries of every backend, the
+// status of every move, the move generator, and that validate_move leaves
+// the game untouched and is_checkmate returns.
+
+#define INPUT_HEADER 65
+#define MAX_INPUT 4096
+#define INPUT_TIMEOUT 5 // seconds before a hanging input kills the standalone driver
+
+static const char square_pieces[] = "PNBRQKpnbrqk";
+static const int piece_limits[12] = {8, 2, 2, 2, 1, 1, 8, 2, 2, 2, 1, 1};
+
+static void fail(const char *what, ChessGame *game, const char *detail)
+{
+    fprintf(stderr, "fuzz: %s (%s)\n", what, detail);
+    for (int row = 0; row < 8; row++)
+    {
+        fprintf(stderr, "  %.8s\n", game->board[row]);
+    }
+    fprintf(stderr, "  %s to move\n", game->current_player == 1 ? "white" : "black");
+    abort();
+}
+
+// Board from the input, with exactly one king of each colour and no more
+// pieces than the starting position, like every position the server can
+// reach since pawns never promote
+static void decode_position(const uint8_t *data, ChessGame *game)
+{
+    int counts[12] = {0};
+
+    memset(game, 0, sizeof(*game));
+    for (int square = 0; square < 64; square++)
+    {
+        // About half of the squares stay empty
+        int pick = data[square] % 24;
+        char piece = '.';
+        if (pick < 12 && counts[pick] < piece_limits[pick])
+        {
+            piece = square_pieces[pick];
+            counts[pick]++;
+        }
+        game->board[square / 8][square % 8] = piece;
+    }
+    // A missing king goes on the back rank, never on top of the other king
+    if (!counts[5])
+    {
+        int col = data[0] % 8;
+        game->board[7][game->board[7][col] == 'k' ? (col + 1) % 8 : col] = 'K';
+    }
+    if (!counts[11])
+    {
+        int col = data[1] % 8;
+        game->board[0][game->board[0][col] == 'K' ? (col + 1) % 8 : col] = 'k';
+    }
+
+    locate_kings(game);
+    game->current_player = data[64] & 1 ? 2 : 1;
+    game->en_passant.row = -1;
+    game->en_passant.col = -1;
+}
+
+// Reference attack query: walk every ray from the square, bounds first
+static int reference_attacked(char board[8][8], int row, int col, int isPlayerWhite)
+{
+    static const int lines[8][2] = {
+        {1, 1}, {1, -1}, {-1, 1}, {-1, -1}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    static const int jumps[8][2] = {
+        {2, 1}, {2, -1}, {-2, 1}, {-2, -1}, {1, 2}, {1, -2}, {-1, 2}, {-1, -2}};
+
+    for (int dir = 0; dir < 8; dir++)
+    {
+        char slider = dir < 4 ? 'b' : 'r';
+        for (int r = row + lines[dir][0], c = col + lines[dir][1];
+             r >= 0 && r < 8 && c >= 0 && c < 8;
+             r += lines[dir][0], c += lines[dir][1])
+        {
+            char piece = board[r][c];
+            if (piece == '.')
+            {
+                continue;
+            }
+            // Only pieces of the other colour attack
+            if ((piece > 96) == isPlayerWhite && (tolower(piece) == 'q' || tolower(piece) == slider))
+            {
+                return 1;
+            }
+            break;
+        }
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        int r = row + jumps[i][0];
+        int c = col + jumps[i][1];
+        if (r >= 0 && r < 8 && c >= 0 && c < 8 && board[r][c] == (isPlayerWhite ? 'n' : 'N'))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Reference move status, in the order the server reports problems
+static MoveStatus reference_status(ChessGame *game, Move *move, int isPlayerWhite)
+{
+    int fr = move->from_row, fc = move->from_col, tr = move->to_row, tc = move->to_col;
+    if (fr < 0 || fr > 7 || fc < 0 || fc > 7 || tr < 0 || tr > 7 || tc < 0 || tc > 7)
+    {
+        return MOVE_OUT_OF_BOARD;
+    }
+    if (fr == tr && fc == tc)
+    {
+        return MOVE_NO_MOVE;
+    }
+
+    char piece = game->board[fr][fc];
+    char target = game->board[tr][tc];
+    if (piece == '.')
+    {
+        return MOVE_NO_PIECE;
+    }
+    if (isPlayerWhite && piece > 96)
+    {
+        return MOVE_BLACK_PIECE;
+    }
+    if (!isPlayerWhite && piece < 96)
+    {
+        return MOVE_WHITE_PIECE;
+    }
+
+    int dr = abs(fr - tr);
+    int dc = abs(fc - tc);
+    int pattern;
+    switch (tolower(piece))
+    {
+    case 'p':
+        // Pawns step one square either way; a diagonal step is a capture,
+        // where an empty square counts as a white piece
+        if (dr == 1 && dc == 1)
+        {
+            if (isPlayerWhite == (target < 96))
+            {
+                return MOVE_PAWN_CANNOT_TAKE;
+            }
+            pattern = 1;
+        }
+        else
+        {
+            pattern = dc == 0 && dr == 1;
+        }
+        break;
+    case 'n':
+        pattern = (dr == 2 && dc == 1) || (dr == 1 && dc == 2);
+        break;
+    case 'b':
+        pattern = dr == dc;
+        break;
+    case 'r':
+        pattern = dr == 0 || dc == 0;
+        break;
+    case 'q':
+        pattern = dr == dc || dr == 0 || dc == 0;
+        break;
+    case 'k':
+        pattern = dr <= 1 && dc <= 1;
+        break;
+    default:
+        pattern = 0;
+    }
+    if (!pattern)
+    {
+        return MOVE_WRONG_PATTERN;
+    }
+
+    if (target != '.' && isPlayerWhite != (target > 96))
+    {
+        return MOVE_OWN_PIECE;
+    }
+
+    char board[8][8];
+    memcpy(board, game->board, sizeof(board));
+    board[tr][tc] = piece;
+    board[fr][fc] = '.';
+    for (int square = 0; square < 64; square++)
+    {
+        if (board[square / 8][square % 8] == (isPlayerWhite ? 'K' : 'k'))
+        {
+            return reference_attacked(board, square / 8, square % 8, isPlayerWhite) ? MOVE_KING_EXPOSED : MOVE_VALID;
+        }
+    }
+    return MOVE_VALID;
+}
+
+static void check_attacks(ChessGame *game)
+{
+    AttackBackend original = get_attack_backend();
+    for (int backend = ATTACK_SCALAR; backend <= ATTACK_AVX2; backend++)
+    {
+        if (set_attack_backend(backend) < 0)
+        {
+            continue;
+        }
+        for (int square = 0; square < 64; square++)
+        {
+            Tile tile = {square / 8, square % 8};
+            for (int white = 0; white <= 1; white++)
+            {
+                int expected = reference_attacked(game->board, tile.row, tile.col, white);
+                int diagonal = check_diagonals(game->board, &tile, white);
+                int straight = check_straights(game->board, &tile, white);
+                int knight = check_knight(game->board, &tile, white);
+                if (is_tile_attacked(game->board, &tile, white) != expected ||
+                    (diagonal || straight || knight) != expected ||
+                    diagonal != check_diagonals_scalar(game->board, &tile, white) ||
+                    straight != check_straights_scalar(game->board, &tile, white) ||
+                    knight != check_knight_scalar(game->board, &tile, white))
+                {
+                    char detail[64];
+                    sprintf(detail, "%s backend, square %c%c, %s defends", attack_backend_name(backend),
+                            'a' + tile.col, '8' - tile.row, white ? "white" : "black");
+                    fail("attack query differs from the reference", game, detail);
+                }
+            }
+        }
+    }
+    set_attack_backend(original);
+}
+
+static void check_move(ChessGame *game, Move *move, const char *text)
+{
+    int isPlayerWhite = game->current_player == 1;
+    ChessGame before = *game;
+    MoveStatus status = validate_move(game, move, isPlayerWhite);
+    if (memcmp(&before, game, sizeof(before)) != 0)
+    {
+        fail("validate_move changed the game", &before, text);
+    }
+    if (status != reference_status(game, move, isPlayerWhite))
+    {
+        char detail[128];
+        snprintf(detail, sizeof(detail), "move %s: %s, reference says %s", text, move_status_message(status),
+                 move_status_message(reference_status(game, move, isPlayerWhite)));
+        fail("move status differs from the reference", game, detail);
+    }
+}
+
+// The generator must produce exactly the moves the reference accepts, and
+// mate detection has to come back for every check a move gives
+static void check_generator(ChessGame *game)
+{
+    int isPlayerWhite = game->current_player == 1;
+    Move moves[MAX_MOVES];
+    int count = generate_moves(game, isPlayerWhite, moves);
+    int expected = 0;
+    int found[64][64];
+    memset(found, 0, sizeof(found));
+
+    for (int i = 0; i < count; i++)
+    {
+        found[moves[i].from_row * 8 + moves[i].from_col][moves[i].to_row * 8 + moves[i].to_col]++;
+    }
+    for (int from = 0; from < 64; from++)
+    {
+        for (int to = 0; to < 64; to++)
+        {
+            Move move = {from / 8, from % 8, to / 8, to % 8};
+            int valid = reference_status(game, &move, isPlayerWhite) == MOVE_VALID;
+            expected += valid;
+            if (found[from][to] != valid)
+            {
+                char detail[32];
+                sprintf(detail, "move %c%c%c%c", 'a' + from % 8, '8' - from / 8, 'a' + to % 8, '8' - to / 8);
+                fail("generator differs from the reference", game, detail);
+            }
+        }
+    }
+    if (count != expected)
+    {
+        fail("generator move count differs from the reference", game, "duplicates");
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        ChessGame after = *game;
+        move_king(&after, &moves[i]);
+        apply_move(&moves[i], after.board);
+        if (is_king_checked(&after, !isPlayerWhite))
+        {
+            is_checkmate(&after, &moves[i], isPlayerWhite);
+        }
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    ChessGame game;
+    if (size < INPUT_HEADER || size > MAX_INPUT)
+    {
+        return 0;
+    }
+
+    decode_position(data, &game);
+    check_attacks(&game);
+    check_generator(&game);
+
+    for (size_t pos = INPUT_HEADER; pos + 4 <= size; pos += 4)
+    {
+        char text[5];
+        memcpy(text, data + pos, 4);
+        text[4] = '\0';
+        Move move = convert(text);
+        check_move(&game, &move, text);
+    }
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+static void input_timeout(int signal)
+{
+    (void)signal;
+    const char message[] = "fuzz: input timed out, the rule code hangs on it\n";
+    write(STDERR_FILENO, message, sizeof(message) - 1);
+    abort();
+}
+
+static int run_file(const char *path)
+{
+    static uint8_t data[MAX_INPUT];
+    FILE *input = fopen(path, "rb");
+    if (input == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    size_t size = fread(data, 1, MAX_INPUT, input);
+    fclose(input);
+    alarm(INPUT_TIMEOUT);
+    LLVMFuzzerTestOneInput(data, size);
+    alarm(0);
+    return 0;
+}
+
+// Random inputs, moves are biased towards the board so most get past the
+// bounds check
+static void run_random(int seconds, unsigned int seed)
+{
+    uint8_t data[INPUT_HEADER + 4 * 16];
+    time_t end = time(NULL) + seconds;
+    long runs = 0;
+
+    srand(seed);
+    printf("fuzz: random inputs for %d s, seed %u\n", seconds, seed);
+    while (time(NULL) < end)
+    {
+        for (int i = 0; i < INPUT_HEADER; i++)
+        {
+            data[i] = rand();
+        }
+        for (size_t i = INPUT_HEADER; i < sizeof(data); i++)
+        {
+            int on_board = rand() % 16 != 0;
+            data[i] = on_board ? ((i - INPUT_HEADER) % 2 ? '1' + rand() % 8 : 'a' + rand() % 8) : rand();
+        }
+        alarm(INPUT_TIMEOUT);
+        LLVMFuzzerTestOneInput(data, sizeof(data));
+        alarm(0);
+        runs++;
+    }
+    printf("fuzz: %ld inputs, no differences\n", runs);
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = 10;
+    unsigned int seed = time(NULL);
+    int files = 0;
+
+    signal(SIGALRM, input_timeout);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            seconds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (argv[i][0] == '-')
+        {
+            printf("usage: %s [-t SECONDS] [-s SEED] [FILE...]\n", argv[0]);
+            return 1;
+        }
+        else if (run_file(argv[i]) == 0)
+        {
+            files++;
+        }
+    }
+    if (files == 0)
+    {
+        run_random(seconds, seed);
+    }
+    return 0;
+}
+#endif
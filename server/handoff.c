@@ -0,0 +1,369 @@
+#include "handoff.h"
+#include "history.h"
+#include <sys/un.h>
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *pos = data;
+    while (size > 0)
+    {
+        ssize_t written = write(fd, pos, size);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return -1;
+        }
+        pos += written;
+        size -= written;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t size)
+{
+    char *pos = data;
+    while (size > 0)
+    {
+        ssize_t got = read(fd, pos, size);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return -1;
+        }
+        pos += got;
+        size -= got;
+    }
+    return 0;
+}
+
+static void fill_address(struct sockaddr_un *address, const char *path)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strncpy(address->sun_path, path, sizeof(address->sun_path) - 1);
+}
+
+// Socket the running server watches for a takeover request
+int handoff_listen(const char *path)
+{
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("handoff socket");
+        return -1;
+    }
+
+    fill_address(&address, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 1) < 0)
+    {
+        perror("handoff bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Descriptors travel in the order: listening socket, then player 1 and
+// player 2 of every active game, then the waiting room. Returns the number
+// of descriptors.
+static int collect_fds(int server_fd, GameManager *gm, WaitingRoom *room, int *fds)
+{
+    int count = 0;
+    fds[count++] = server_fd;
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        if (!gm->games[i].is_active)
+        {
+            continue;
+        }
+        if (gm->games[i].player1_socket > 0)
+        {
+            fds[count++] = gm->games[i].player1_socket;
+        }
+        if (gm->games[i].player2_socket > 0)
+        {
+            fds[count++] = gm->games[i].player2_socket;
+        }
+    }
+    for (int i = 0; i < room->count; i++)
+    {
+        fds[count++] = room->players[i].socket;
+    }
+    return count;
+}
+
+// Histories hold pointers, every game is sent as the move count and the moves
+static int send_histories(int connection, GameManager *gm)
+{
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        MoveHistory *history = &gm->games[i].history;
+        if (!gm->games[i].is_active)
+        {
+            continue;
+        }
+        if (write_all(connection, &history->count, sizeof(int)) < 0)
+        {
+            return -1;
+        }
+
+        int remaining = history->count;
+        for (HistoryChunk *chunk = history->first; remaining > 0; chunk = chunk->next)
+        {
+            int count = remaining < HISTORY_CHUNK_MOVES ? remaining : HISTORY_CHUNK_MOVES;
+            if (write_all(connection, chunk->moves, sizeof(PackedMove) * count) < 0 ||
+                write_all(connection, chunk->captured, count) < 0 ||
+                write_all(connection, chunk->states, count) < 0)
+            {
+                return -1;
+            }
+            remaining -= count;
+        }
+    }
+    return 0;
+}
+
+static int receive_histories(int connection, GameManager *gm)
+{
+    PackedMove moves[HISTORY_CHUNK_MOVES];
+    char captured[HISTORY_CHUNK_MOVES];
+    unsigned char states[HISTORY_CHUNK_MOVES];
+
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        history_init(&gm->games[i].history);
+    }
+
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        int remaining;
+        if (!gm->games[i].is_active)
+        {
+            continue;
+        }
+        if (read_all(connection, &remaining, sizeof(int)) < 0 || remaining < 0)
+        {
+            return -1;
+        }
+
+        while (remaining > 0)
+        {
+            int count = remaining < HISTORY_CHUNK_MOVES ? remaining : HISTORY_CHUNK_MOVES;
+            if (read_all(connection, moves, sizeof(PackedMove) * count) < 0 ||
+                read_all(connection, captured, count) < 0 ||
+                read_all(connection, states, count) < 0)
+            {
+                return -1;
+            }
+            for (int j = 0; j < count; j++)
+            {
+                if (history_push(&gm->games[i].history, moves[j], captured[j]) < 0)
+                {
+                    return -1;
+                }
+                history_set_state(&gm->games[i].history, states[j]);
+            }
+            remaining -= count;
+        }
+    }
+    return 0;
+}
+
+static int send_fds(int connection, int *fds, int count)
+{
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)];
+    char byte = 'f';
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    return sendmsg(connection, &msg, 0) == 1 ? 0 : -1;
+}
+
+static int receive_fds(int connection, int *fds, int count)
+{
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_FDS_PER_MESSAGE)];
+    char byte;
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(connection, &msg, 0) != 1)
+    {
+        return -1;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int) * count))
+    {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+    return 0;
+}
+
+// Hand the server over to the process on the other end of the connection.
+// Returns 0 once the new process confirmed it owns every socket, after which
+// this process must exit without touching the players.
+int handoff_send(int connection, int server_fd, GameManager *gm, WaitingRoom *room)
+{
+    int *fds = malloc(sizeof(int) * (MAX_GAMES * 2 + 1 + room->count));
+    if (fds == NULL)
+    {
+        return -1;
+    }
+
+    HandoffHeader header;
+    header.magic = HANDOFF_MAGIC;
+    header.max_games = MAX_GAMES;
+    header.game_size = sizeof(ChessGame);
+    header.waiting_count = room->count;
+    header.fd_count = collect_fds(server_fd, gm, room, fds);
+
+    int result = -1;
+    if (write_all(connection, &header, sizeof(header)) == 0 &&
+        write_all(connection, gm, sizeof(GameManager)) == 0 &&
+        write_all(connection, room->players, sizeof(WaitingPlayer) * room->count) == 0 &&
+        send_histories(connection, gm) == 0)
+    {
+        result = 0;
+        for (int sent = 0; sent < header.fd_count && result == 0; sent += HANDOFF_FDS_PER_MESSAGE)
+        {
+            int count = header.fd_count - sent;
+            if (count > HANDOFF_FDS_PER_MESSAGE)
+            {
+                count = HANDOFF_FDS_PER_MESSAGE;
+            }
+            result = send_fds(connection, fds + sent, count);
+        }
+    }
+
+    char ack;
+    if (result == 0 && (read_all(connection, &ack, 1) < 0 || ack != 'k'))
+    {
+        result = -1;
+    }
+
+    free(fds);
+    return result;
+}
+
+// Connect to the running server and take over its sockets and games
+int handoff_receive(const char *path, int *server_fd, GameManager *gm, WaitingRoom *room)
+{
+    struct sockaddr_un address;
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0)
+    {
+        perror("handoff socket");
+        return -1;
+    }
+
+    fill_address(&address, path);
+    if (connect(connection, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        perror("handoff connect");
+        close(connection);
+        return -1;
+    }
+
+    HandoffHeader header;
+    if (read_all(connection, &header, sizeof(header)) < 0 ||
+        header.magic != HANDOFF_MAGIC || header.max_games != MAX_GAMES ||
+        header.game_size != (int)sizeof(ChessGame) ||
+        header.waiting_count < 0 || header.waiting_count > room->capacity ||
+        header.fd_count < 1 || header.fd_count > MAX_GAMES * 2 + 1 + header.waiting_count)
+    {
+        printf("Handoff rejected, the running server was built or configured differently\n");
+        close(connection);
+        return -1;
+    }
+
+    int *fds = malloc(sizeof(int) * header.fd_count);
+    if (fds == NULL || read_all(connection, gm, sizeof(GameManager)) < 0 ||
+        read_all(connection, room->players, sizeof(WaitingPlayer) * header.waiting_count) < 0 ||
+        receive_histories(connection, gm) < 0)
+    {
+        free(fds);
+        close(connection);
+        return -1;
+    }
+
+    for (int received = 0; received < header.fd_count; received += HANDOFF_FDS_PER_MESSAGE)
+    {
+        int count = header.fd_count - received;
+        if (count > HANDOFF_FDS_PER_MESSAGE)
+        {
+            count = HANDOFF_FDS_PER_MESSAGE;
+        }
+        if (receive_fds(connection, fds + received, count) < 0)
+        {
+            printf("Handoff failed while receiving sockets\n");
+            for (int i = 0; i < received; i++)
+            {
+                close(fds[i]);
+            }
+            free(fds);
+            close(connection);
+            return -1;
+        }
+    }
+
+    // Replace the descriptor numbers of the old process with ours,
+    // walking the games in the same order as collect_fds
+    int next = 0;
+    *server_fd = fds[next++];
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        if (!gm->games[i].is_active)
+        {
+            gm->games[i].player1_socket = -1;
+            gm->games[i].player2_socket = -1;
+            continue;
+        }
+        if (gm->games[i].player1_socket > 0)
+        {
+            gm->games[i].player1_socket = fds[next++];
+        }
+        if (gm->games[i].player2_socket > 0)
+        {
+            gm->games[i].player2_socket = fds[next++];
+        }
+    }
+    room->count = header.waiting_count;
+    for (int i = 0; i < room->count; i++)
+    {
+        room->players[i].socket = fds[next++];
+    }
+
+    write_all(connection, "k", 1);
+    free(fds);
+    close(connection);
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include "utils.h"
+#include "admission.h"
+
+// A restarted server takes over the listening socket, the player sockets and
+// the game state of the running one over a Unix domain socket
+
+#define HANDOFF_MAGIC 0x43484f46 // "CHOF"
+#define HANDOFF_FDS_PER_MESSAGE 128
+
+typedef struct
+{
+    int magic;
+    int max_games;
+    int game_size;
+    int waiting_count;
+    int fd_count;
+} HandoffHeader;
+
+int handoff_listen(const char *path);
+int handoff_send(int connection, int server_fd, GameManager *gm, WaitingRoom *room);
+int handoff_receive(const char *path, int *server_fd, GameManager *gm, WaitingRoom *room);
+#endif // HANDOFF_H
@@ -0,0 +1,398 @@
+#include "history.h"
+#include "fen.h"
+#include <stdarg.h>
+
+// Chunks come from a free list shared by all games and are never returned to
+// malloc, so a finished game's chunks are reused by the next one. The pool is
+// only used from the network loop and needs no locking.
+static HistoryChunk *free_chunks = NULL;
+static long pool_chunks = 0;
+
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+static HistoryChunk *take_chunk(void)
+{
+    if (free_chunks == NULL)
+    {
+        HistoryChunk *slab = malloc(sizeof(HistoryChunk) * HISTORY_SLAB_CHUNKS);
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+        for (int i = 0; i < HISTORY_SLAB_CHUNKS; i++)
+        {
+            slab[i].next = free_chunks;
+            free_chunks = &slab[i];
+        }
+        pool_chunks += HISTORY_SLAB_CHUNKS;
+    }
+
+    HistoryChunk *chunk = free_chunks;
+    free_chunks = chunk->next;
+    chunk->next = NULL;
+    return chunk;
+}
+
+PackedMove pack_move(Move *move, int promotion, int flags)
+{
+    return (PackedMove)((move->from_row * 8 + move->from_col) |
+                        ((move->to_row * 8 + move->to_col) << 6) |
+                        ((promotion & 3) << 12) |
+                        ((flags & 3) << 14));
+}
+
+Move unpack_move(PackedMove packed)
+{
+    Move move;
+    move.from_row = PACKED_FROM(packed) / 8;
+    move.from_col = PACKED_FROM(packed) % 8;
+    move.to_row = PACKED_TO(packed) / 8;
+    move.to_col = PACKED_TO(packed) % 8;
+    return move;
+}
+
+void history_init(MoveHistory *history)
+{
+    history->first = NULL;
+    history->last = NULL;
+    history->count = 0;
+}
+
+// Returns -1 when no chunk could be allocated
+int history_push(MoveHistory *history, PackedMove move, char captured)
+{
+    int index = history->count % HISTORY_CHUNK_MOVES;
+    if (index == 0)
+    {
+        HistoryChunk *chunk = take_chunk();
+        if (chunk == NULL)
+        {
+            return -1;
+        }
+        if (history->last == NULL)
+        {
+            history->first = chunk;
+        }
+        else
+        {
+            history->last->next = chunk;
+        }
+        history->last = chunk;
+    }
+
+    history->last->moves[index] = move;
+    history->last->captured[index] = captured;
+    history->last->states[index] = 0;
+    history->count++;
+    return 0;
+}
+
+// Returns 0 when there is no move with this index
+int history_get(MoveHistory *history, int index, PackedMove *move, char *captured)
+{
+    if (index < 0 || index >= history->count)
+    {
+        return 0;
+    }
+
+    HistoryChunk *chunk = history->first;
+    for (int i = 0; i < index / HISTORY_CHUNK_MOVES; i++)
+    {
+        chunk = chunk->next;
+    }
+    *move = chunk->moves[index % HISTORY_CHUNK_MOVES];
+    *captured = chunk->captured[index % HISTORY_CHUNK_MOVES];
+    return 1;
+}
+
+// Record the check and mate verdicts of the newest move
+void history_set_state(MoveHistory *history, int state)
+{
+    if (history->count > 0)
+    {
+        history->last->states[(history->count - 1) % HISTORY_CHUNK_MOVES] = state;
+    }
+}
+
+// MOVE_CHECK and MOVE_MATE of the move with this index, 0 when there is none
+int history_state(MoveHistory *history, int index)
+{
+    if (index < 0 || index >= history->count)
+    {
+        return 0;
+    }
+
+    HistoryChunk *chunk = history->first;
+    for (int i = 0; i < index / HISTORY_CHUNK_MOVES; i++)
+    {
+        chunk = chunk->next;
+    }
+    return chunk->states[index % HISTORY_CHUNK_MOVES];
+}
+
+// Remove the last move, for takebacks. Returns 0 when the history is empty.
+int history_pop(MoveHistory *history, PackedMove *move, char *captured)
+{
+    if (history->count == 0)
+    {
+        return 0;
+    }
+
+    history->count--;
+    int index = history->count % HISTORY_CHUNK_MOVES;
+    *move = history->last->moves[index];
+    *captured = history->last->captured[index];
+
+    if (index == 0)
+    {
+        // The last chunk is empty now, give it back
+        HistoryChunk *chunk = history->last;
+        if (history->first == chunk)
+        {
+            history->first = NULL;
+            history->last = NULL;
+        }
+        else
+        {
+            HistoryChunk *previous = history->first;
+            while (previous->next != chunk)
+            {
+                previous = previous->next;
+            }
+            previous->next = NULL;
+            history->last = previous;
+        }
+        chunk->next = free_chunks;
+        free_chunks = chunk;
+    }
+    return 1;
+}
+
+void history_clear(MoveHistory *history)
+{
+    if (history->first != NULL)
+    {
+        history->last->next = free_chunks;
+        free_chunks = history->first;
+    }
+    history_init(history);
+}
+
+// Copy the history into one malloc'ed block outside the pool, for a worker
+// thread to read while the game goes on. Returns -1 when out of memory.
+int history_snapshot(MoveHistory *history, MoveHistory *copy)
+{
+    int chunks = (history->count + HISTORY_CHUNK_MOVES - 1) / HISTORY_CHUNK_MOVES;
+    history_init(copy);
+    if (chunks == 0)
+    {
+        return 0;
+    }
+
+    HistoryChunk *block = malloc(sizeof(HistoryChunk) * chunks);
+    if (block == NULL)
+    {
+        return -1;
+    }
+    HistoryChunk *chunk = history->first;
+    for (int i = 0; i < chunks; i++, chunk = chunk->next)
+    {
+        memcpy(block[i].moves, chunk->moves, sizeof(chunk->moves));
+        memcpy(block[i].captured, chunk->captured, sizeof(chunk->captured));
+        memcpy(block[i].states, chunk->states, sizeof(chunk->states));
+        block[i].next = i + 1 < chunks ? &block[i + 1] : NULL;
+    }
+    copy->first = block;
+    copy->last = &block[chunks - 1];
+    copy->count = history->count;
+    return 0;
+}
+
+void history_free_snapshot(MoveHistory *copy)
+{
+    free(copy->first);
+    history_init(copy);
+}
+
+// Chunks allocated by the pool, in use or free
+long history_pool_chunks(void)
+{
+    return pool_chunks;
+}
+
+static int append(TextBuffer *text, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (text->length + needed + 1 > text->capacity)
+    {
+        size_t capacity = text->capacity ? text->capacity * 2 : 1024;
+        while (capacity < text->length + needed + 1)
+        {
+            capacity *= 2;
+        }
+        char *data = realloc(text->data, capacity);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+
+    va_start(args, format);
+    vsnprintf(text->data + text->length, needed + 1, format, args);
+    va_end(args);
+    text->length += needed;
+    return 0;
+}
+
+// Standard algebraic notation without the check suffix, the move is not played
+static void write_san(ChessGame *position, Move *move, char *san)
+{
+    char piece = position->board[move->from_row][move->from_col];
+    int is_capture = position->board[move->to_row][move->to_col] != '.';
+    int isPlayerWhite = piece < 96;
+    int pos = 0;
+
+    if (tolower(piece) == 'p')
+    {
+        if (is_capture)
+        {
+            san[pos++] = 'a' + move->from_col;
+        }
+    }
+    else
+    {
+        san[pos++] = toupper(piece);
+
+        // Name the file or rank when another piece of the same kind could go there too
+        int ambiguous = 0;
+        int same_col = 0;
+        int same_row = 0;
+        for (int square = 0; square < 64; square++)
+        {
+            Move other;
+            other.from_row = square / 8;
+            other.from_col = square % 8;
+            other.to_row = move->to_row;
+            other.to_col = move->to_col;
+            if ((other.from_row == move->from_row && other.from_col == move->from_col) ||
+                position->board[other.from_row][other.from_col] != piece ||
+                validate_move(position, &other, isPlayerWhite) != MOVE_VALID)
+            {
+                continue;
+            }
+            ambiguous = 1;
+            same_col |= other.from_col == move->from_col;
+            same_row |= other.from_row == move->from_row;
+        }
+        if (ambiguous && (!same_col || same_row))
+        {
+            san[pos++] = 'a' + move->from_col;
+        }
+        if (ambiguous && same_col)
+        {
+            san[pos++] = '8' - move->from_row;
+        }
+    }
+
+    if (is_capture)
+    {
+        san[pos++] = 'x';
+    }
+    san[pos++] = 'a' + move->to_col;
+    san[pos++] = '8' - move->to_row;
+    san[pos] = '\0';
+}
+
+// Replay the game from its starting position and write it as PGN, the
+// result is malloc'ed and NULL on failure
+char *history_export_pgn(ChessGame *game, const char *start_fen, const char *white, const char *black)
+{
+    ChessGame position;
+    TextBuffer text = {NULL, 0, 0};
+    int failed = 0;
+
+    memset(&position, 0, sizeof(position));
+    if (load_fen(&position, start_fen) != 0)
+    {
+        return NULL;
+    }
+
+    failed |= append(&text, "[Event \"Game #%d\"]\n[Site \"?\"]\n[Date \"????.??.??\"]\n[Round \"?\"]\n", game->game_id);
+    failed |= append(&text, "[White \"%s\"]\n[Black \"%s\"]\n[Result \"*\"]\n", white, black);
+    if (strcmp(start_fen, START_FEN) != 0)
+    {
+        failed |= append(&text, "[SetUp \"1\"]\n[FEN \"%s\"]\n", start_fen);
+    }
+    failed |= append(&text, "\n");
+
+    int line_length = 0;
+    for (int i = 0; i < game->history.count && !failed; i++)
+    {
+        PackedMove packed;
+        char captured;
+        char token[32];
+        char san[16];
+        int len = 0;
+
+        history_get(&game->history, i, &packed, &captured);
+        Move move = unpack_move(packed);
+        int isPlayerWhite = position.current_player == 1;
+
+        if (isPlayerWhite)
+        {
+            len = sprintf(token, "%d. ", position.turn);
+        }
+        else if (i == 0)
+        {
+            len = sprintf(token, "%d... ", position.turn);
+        }
+
+        write_san(&position, &move, san);
+        char piece = position.board[move.from_row][move.from_col];
+        move_king(&position, &move);
+        char piece_taken = apply_move(&move, position.board);
+        update_position_state(&position, &move, piece, piece_taken);
+        if (is_checkmate(&position, &move, isPlayerWhite))
+        {
+            strcat(san, "#");
+        }
+        else if (is_king_checked(&position, !isPlayerWhite))
+        {
+            strcat(san, "+");
+        }
+        position.current_player = isPlayerWhite ? 2 : 1;
+        len += sprintf(token + len, "%s", san);
+        if (i < game->book_plies)
+        {
+            len += sprintf(token + len, " {book}");
+        }
+
+        // Keep the movetext lines under 80 characters
+        if (line_length > 0 && line_length + 1 + len > 79)
+        {
+            failed |= append(&text, "\n");
+            line_length = 0;
+        }
+        failed |= append(&text, line_length > 0 ? " %s" : "%s", token);
+        line_length += len + (line_length > 0);
+    }
+
+    failed |= append(&text, line_length > 0 ? " *\n" : "*\n");
+    if (failed)
+    {
+        free(text.data);
+        return NULL;
+    }
+    return text.data;
+}
@@ -0,0 +1,39 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "utils.h"
+
+#define MOVE_FLAG_CAPTURE 1
+#define MOVE_FLAG_PROMOTION 2
+
+// What the rules said after a move, kept next to it in the history
+#define MOVE_CHECK 1
+#define MOVE_MATE 2
+
+#define PROMOTION_KNIGHT 0
+#define PROMOTION_BISHOP 1
+#define PROMOTION_ROOK 2
+#define PROMOTION_QUEEN 3
+
+// Chunks are taken from the pool this many at a time
+#define HISTORY_SLAB_CHUNKS 64
+
+#define PACKED_FROM(packed) ((packed) & 63)
+#define PACKED_TO(packed) (((packed) >> 6) & 63)
+#define PACKED_PROMOTION(packed) (((packed) >> 12) & 3)
+#define PACKED_FLAGS(packed) (((packed) >> 14) & 3)
+
+PackedMove pack_move(Move *move, int promotion, int flags);
+Move unpack_move(PackedMove packed);
+void history_init(MoveHistory *history);
+int history_push(MoveHistory *history, PackedMove move, char captured);
+int history_get(MoveHistory *history, int index, PackedMove *move, char *captured);
+void history_set_state(MoveHistory *history, int state);
+int history_state(MoveHistory *history, int index);
+int history_pop(MoveHistory *history, PackedMove *move, char *captured);
+void history_clear(MoveHistory *history);
+int history_snapshot(MoveHistory *history, MoveHistory *copy);
+void history_free_snapshot(MoveHistory *copy);
+long history_pool_chunks(void);
+char *history_export_pgn(ChessGame *game, const char *start_fen, const char *white, const char *black);
+#endif // HISTORY_H
@@ -0,0 +1,351 @@
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Load generator for comparing the event backends: GAMES pairs of players
+// move their knights back and forth for SECONDS and the moves per second
+// are reported. With -s PID the system calls of every thread of the server
+// are counted through the raw_syscalls tracepoint, which needs tracefs and
+// perf events, and reported per move, the writes of the server log apart.
+// The server should run with --accept-rate 0 --max-per-ip 0.
+//
+// usage: loadgen [-p PORT] [-g GAMES] [-t SECONDS] [-s PID]
+
+#define LOADGEN_EVENTS 256
+#define LOADGEN_LINE 128
+#define LOADGEN_THREADS 256 // server threads that can be counted
+#define LOADGEN_START_MS 30000
+
+typedef struct
+{
+    int fd;
+    int white;   // -1 until the welcome tells
+    int started; // both players are seated
+    int boards;  // boards received, the first one is the start position
+    int moved;   // plies played when this player last moved
+    char line[LOADGEN_LINE];
+    int line_length;
+} Player;
+
+typedef struct
+{
+    int all[LOADGEN_THREADS];
+    int writes[LOADGEN_THREADS];
+    int count;
+} Counters;
+
+static const char *white_moves[] = {"g1f3\n", "f3g1\n"};
+static const char *black_moves[] = {"g8f6\n", "f6g8\n"};
+
+static long moves = 0;
+static long errors = 0;
+static long ended = 0;
+static int started = 0;
+
+static double now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+static void handle_line(Player *player)
+{
+    char *line = player->line;
+    if (strncmp(line, "board ", 6) == 0)
+    {
+        player->boards++;
+        if (player->white == 1 && player->boards > 1)
+        {
+            moves++;
+        }
+    }
+    else if (strstr(line, "You are Player White") != NULL)
+    {
+        player->white = 1;
+    }
+    else if (strstr(line, "You are Player Black") != NULL)
+    {
+        player->white = 0;
+    }
+    else if (strstr(line, "is starting!") != NULL && !player->started)
+    {
+        player->started = 1;
+        started++;
+    }
+    else if (line[0] == 'e' && line[1] == ' ')
+    {
+        errors++;
+    }
+    else if (line[0] == 'x' && line[1] == ' ')
+    {
+        ended++;
+    }
+}
+
+// Move when the last board shows it is this player's turn
+static void play(Player *player)
+{
+    int plies = player->boards - 1;
+    if (!player->started || plies < 0 || plies == player->moved || plies % 2 != (player->white ? 0 : 1))
+    {
+        return;
+    }
+    const char *move = player->white ? white_moves[(plies / 2) % 2] : black_moves[(plies / 2) % 2];
+    if (send(player->fd, move, strlen(move), MSG_NOSIGNAL) > 0)
+    {
+        player->moved = plies;
+    }
+}
+
+static void receive(Player *player)
+{
+    char buffer[4096];
+    int length;
+    while ((length = read(player->fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (int i = 0; i < length; i++)
+        {
+            if (buffer[i] == '\n')
+            {
+                player->line[player->line_length] = '\0';
+                handle_line(player);
+                player->line_length = 0;
+            }
+            else if (player->line_length < LOADGEN_LINE - 1)
+            {
+                player->line[player->line_length++] = buffer[i];
+            }
+        }
+    }
+    play(player);
+}
+
+static int tracepoint_id(void)
+{
+    const char *paths[] = {"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                           "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+    {
+        FILE *file = fopen(paths[i], "r");
+        int id;
+        if (file != NULL && fscanf(file, "%d", &id) == 1)
+        {
+            fclose(file);
+            return id;
+        }
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+    }
+    return -1;
+}
+
+static int open_counter(int id, int thread, const char *filter)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    int fd = syscall(__NR_perf_event_open, &attr, thread, -1, -1, 0);
+    if (fd >= 0 && filter != NULL && ioctl(fd, PERF_EVENT_IOC_SET_FILTER, filter) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// One counter per server thread for all system calls, one for writes
+static int open_counters(Counters *counters, int pid)
+{
+    char path[64];
+    int id = tracepoint_id();
+    if (id < 0)
+    {
+        printf("No raw_syscalls tracepoint, is tracefs mounted?\n");
+        return -1;
+    }
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *tasks = opendir(path);
+    if (tasks == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    struct dirent *task;
+    counters->count = 0;
+    while ((task = readdir(tasks)) != NULL && counters->count < LOADGEN_THREADS)
+    {
+        int thread = atoi(task->d_name);
+        if (thread <= 0)
+        {
+            continue;
+        }
+        counters->all[counters->count] = open_counter(id, thread, NULL);
+        counters->writes[counters->count] = open_counter(id, thread, "id == 1");
+        if (counters->all[counters->count] < 0 || counters->writes[counters->count] < 0)
+        {
+            perror("perf_event_open");
+            closedir(tasks);
+            return -1;
+        }
+        counters->count++;
+    }
+    closedir(tasks);
+    return 0;
+}
+
+static void read_counters(Counters *counters, long *all, long *writes)
+{
+    *all = 0;
+    *writes = 0;
+    for (int i = 0; i < counters->count; i++)
+    {
+        long value;
+        if (read(counters->all[i], &value, sizeof(value)) == sizeof(value))
+        {
+            *all += value;
+        }
+        if (read(counters->writes[i], &value, sizeof(value)) == sizeof(value))
+        {
+            *writes += value;
+        }
+    }
+}
+
+static int connect_player(Player *player, struct sockaddr_in *address)
+{
+    memset(player, 0, sizeof(*player));
+    player->white = -1;
+    player->moved = -1;
+    player->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (player->fd < 0 || connect(player->fd, (struct sockaddr *)address, sizeof(*address)) < 0)
+    {
+        return -1;
+    }
+    fcntl(player->fd, F_SETFL, fcntl(player->fd, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+// Handle whatever the server sent until limit_ms passed or, with until_started,
+// every player is seated
+static void run(int epoll_fd, double limit_ms, int until_started, int players)
+{
+    struct epoll_event events[LOADGEN_EVENTS];
+    double end = now_ms() + limit_ms;
+    while (now_ms() < end && !(until_started && started == players))
+    {
+        int ready = epoll_wait(epoll_fd, events, LOADGEN_EVENTS, 100);
+        for (int i = 0; i < ready; i++)
+        {
+            receive((Player *)events[i].data.ptr);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int port = 8080;
+    int games = 100;
+    int seconds = 10;
+    int server_pid = 0;
+
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0)
+        {
+            port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            games = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            seconds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-s") == 0)
+        {
+            server_pid = atoi(argv[++i]);
+        }
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    int players = games * 2;
+    Player *player = calloc(players, sizeof(Player));
+    int epoll_fd = epoll_create1(0);
+    if (player == NULL || epoll_fd < 0)
+    {
+        perror("loadgen");
+        return 1;
+    }
+
+    double start = now_ms();
+    for (int i = 0; i < players; i++)
+    {
+        if (connect_player(&player[i], &address) < 0)
+        {
+            perror("connect");
+            return 1;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = &player[i];
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, player[i].fd, &event);
+
+        // Keep up with the welcomes, so the server never waits on a full socket
+        if (i % 1000 == 999)
+        {
+            run(epoll_fd, 0, 0, players);
+        }
+    }
+    run(epoll_fd, LOADGEN_START_MS, 1, players);
+    printf("%d of %d players seated in %.0f ms\n", started, players, now_ms() - start);
+
+    Counters counters;
+    long calls_before = 0, writes_before = 0, calls_after = 0, writes_after = 0;
+    if (server_pid > 0 && open_counters(&counters, server_pid) < 0)
+    {
+        server_pid = 0;
+    }
+    if (server_pid > 0)
+    {
+        read_counters(&counters, &calls_before, &writes_before);
+    }
+
+    long moves_before = moves;
+    start = now_ms();
+    run(epoll_fd, seconds * 1000.0, 0, players);
+    double elapsed = now_ms() - start;
+    long played = moves - moves_before;
+
+    printf("%d games: %ld moves in %.1f s, %.0f moves/s, %ld errors, %ld games over\n", games, played,
+           elapsed / 1000, played * 1000.0 / elapsed, errors, ended);
+    if (server_pid > 0 && played > 0)
+    {
+        read_counters(&counters, &calls_after, &writes_after);
+        long calls = calls_after - calls_before;
+        long writes = writes_after - writes_before;
+        printf("server: %ld system calls, %.2f per move, %.2f per move without the %ld log writes\n", calls,
+               (double)calls / played, (double)(calls - writes) / played, writes);
+    }
+    return 0;
+}
@@ -6,20 +6,143 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
 #include <signal.h>
 #include <errno.h>
 #include <ctype.h>
 #include "utils.h"
+#include "fen.h"
+#include "attack.h"
+#include "handoff.h"
+#include "uring.h"
+#include <sys/resource.h>
+#include "engine.h"
+#include "pool.h"
+#include "export.h"
+#include "admission.h"
+#include "history.h"
+#include "book.h"
+#include "tablebase.h"
+#include "archive.h"
+#include "queue.h"
+#include "metrics.h"
+#include "tournament.h"
+#include "footprint.h"
+#include <time.h>
 
 #define PORT 4567
 #define BUFFER_SIZE 1024
+#define MAX_EVENTS 64
+#define URING_ENTRIES 4096
+#define URING_BUFFERS 4096 // received chunks that can wait for the loop at once
+#ifndef TOURNAMENT_START_BATCH
+#define TOURNAMENT_START_BATCH 1024 // games started per pass of the network loop
+#endif
+
+typedef enum
+{
+    EVENTS_SELECT,
+    EVENTS_EPOLL,
+    EVENTS_URING
+} EventBackend;
+
+static const char *event_backend_names[] = {"select", "epoll", "io_uring"};
+
+// What a ring completion belongs to, in the low 3 bits of its user data.
+// Socket requests also carry the socket and, in the high 32 bits, its
+// generation.
+typedef enum
+{
+    RING_ACCEPT = 1,
+    RING_RECV,
+    RING_SEND,
+    RING_BOT_RESULTS,
+    RING_EXPORT_RESULTS,
+    RING_HANDOFF,
+    RING_CLOSE
+} RingRequest;
+
+// Output of a socket in the io_uring loop. Everything sent to it during a
+// pass is gathered and written with one send, and the next send waits for
+// the one in flight, so the player gets the messages in order.
+typedef struct
+{
+    char *pending; // gathered during this pass
+    size_t pending_length;
+    size_t pending_capacity;
+    char *sending; // in flight
+    size_t sending_length;
+    size_t sent;
+    int closing; // close once everything was sent
+    int closed;  // shutdown and close are queued behind the send in flight
+    int dirty;   // listed in ring_dirty
+} RingSocket;
 
 int port, game_time, increment;
+const char *start_fen = START_FEN;
+EventBackend event_backend = EVENTS_EPOLL;
+const char *handoff_path = NULL;
+const char *takeover_path = NULL;
+int bot_after = 0; // seconds a player waits before the engine joins, 0 disables it
+int bot_threads = 2;
+SearchLimits bot_limits = {1000, 0};
+int max_per_ip = 8;         // connections per address, 0 for no limit
+double accept_rate = 100;   // new connections per second, 0 for no limit
+double accept_burst = 200;
+int waiting_room_size = 32;
+int full_retry_ms = 1000;   // retry hint when every game is taken
+const char *book_path = NULL;
+const char *tablebase_path = NULL;
+const char *archive_path = NULL;
+int event_queue_size = 0; // game events ring for service threads, 0 disables it
+int tablebase_adjudicate = 0; // end decided games instead of only announcing the result
+int tournament_rounds = 0;    // Swiss rounds, 0 pairs players as they arrive
+int tournament_players = 16;  // registrations that start the first round
+int round_time = 0;           // seconds before unfinished games of a round are drawn, 0 for no limit
 
 // Global variables for cleanup
 static int server_fd;
 static GameManager *global_game_manager;
+static int handoff_fd = -1;
+static int handed_off = 0;
+static int bot_results_fd = -1;
+static int export_results_fd = -1;
+static unsigned int bot_tickets = 0;
+static int bot_retries[MAX_GAMES]; // games whose engine request the pool refused
+static int bot_retry_count = 0;
+static char bot_retry_queued[MAX_GAMES];
+static TokenBucket accept_bucket;
+static WaitingRoom waiting_room;
+static IpTable ip_counts; // open connections by address
+static Book book;
+static int tablebase_count = 0;
+static int archive_fd = -1;
+static SpscQueue game_events;
+static int events_enabled = 0;
+static long events_dropped = 0;
+static ChessGame start_position; // start_fen parsed once for every new game
+static Tournament tournament;
+static int tournament_next = 0;      // first pairing of the round without a game yet
+static int tournament_games = 0;     // games of the round still being played
+static int tournament_free_slot = 0; // where the search for free games continues
+static int round_games = 0;
+static int round_slices = 0;
+static double round_slice_ms = 0; // longest slice of the round start
+static struct timespec round_started;
 volatile sig_atomic_t server_running = 1;
+static int *socket_games;            // game index by player socket, checked against the game on lookup
+static unsigned *socket_generations; // bumped on close, ring completions of an older generation are stale
+static unsigned *socket_ips;         // address the socket is counted under in ip_counts, 0 when not counted
+static int socket_slots = 0;         // the descriptor limit, every socket is below it
+static Uring ring;
+static int uring_active = 0;
+static RingSocket *ring_sockets;
+static int *ring_dirty; // sockets with output to flush at the end of the pass
+static int ring_dirty_count = 0;
+static int ring_armed = 0;    // multishot requests still producing completions
+static int ring_sends = 0;    // sends in flight
+static int ring_draining = 0; // requests are being taken off the ring
+static int ring_handoff_requested = 0;
 
 // Signal handler function
 void handle_shutdown()
@@ -28,18 +151,153 @@ void handle_shutdown()
     server_running = 0;
 }
 
-void send_error(int socket, char *message)
+static uint64_t ring_data(RingRequest request, int socket)
+{
+    return (uint64_t)socket_generations[socket] << 32 | (uint64_t)socket << 3 | request;
+}
+
+static int ring_socket(uint64_t user_data)
+{
+    return (user_data >> 3) & 0x1fffffff;
+}
+
+static void ring_mark_dirty(int socket)
+{
+    if (!ring_sockets[socket].dirty)
+    {
+        ring_sockets[socket].dirty = 1;
+        ring_dirty[ring_dirty_count++] = socket;
+    }
+}
+
+// Gather output for the socket, it goes out when the pass ends
+static void ring_send(int socket, const void *data, size_t length)
+{
+    RingSocket *output = &ring_sockets[socket];
+    if (output->closing)
+    {
+        return;
+    }
+    if (output->pending_length + length > output->pending_capacity)
+    {
+        size_t capacity = output->pending_capacity ? output->pending_capacity * 2 : 256;
+        while (capacity < output->pending_length + length)
+        {
+            capacity *= 2;
+        }
+        char *pending = realloc(output->pending, capacity);
+        if (pending == NULL)
+        {
+            printf("Out of memory for the output of socket %d\n", socket);
+            return;
+        }
+        output->pending = pending;
+        output->pending_capacity = capacity;
+    }
+    memcpy(output->pending + output->pending_length, data, length);
+    output->pending_length += length;
+    ring_mark_dirty(socket);
+}
+
+// Send to a player. The io_uring loop gathers the output and sends it when
+// the pass ends, the other loops write right away.
+void send_player(int socket, const void *data, size_t length, int flags)
+{
+    if (uring_active && socket >= 0 && socket < socket_slots)
+    {
+        ring_send(socket, data, length);
+        return;
+    }
+    send(socket, data, length, flags);
+}
+
+// The io_uring loop closes the socket once its output went out, completions
+// still on their way for it are dropped
+void close_player(int socket)
+{
+    if (socket >= 0 && socket < socket_slots && socket_ips[socket] != 0)
+    {
+        ip_table_remove(&ip_counts, socket_ips[socket]);
+        socket_ips[socket] = 0;
+    }
+    if (uring_active && socket >= 0 && socket < socket_slots)
+    {
+        ring_sockets[socket].closing = 1;
+        socket_generations[socket]++;
+        ring_mark_dirty(socket);
+        return;
+    }
+    close(socket);
+}
+
+void send_error(int socket, const char *message)
 {
     char buffer[BUFFER_SIZE];
     memset(buffer, 0, BUFFER_SIZE);
     sprintf(buffer, "e %s\n", message);
-    send(socket, buffer, strlen(buffer), 0);
+    send_player(socket, buffer, strlen(buffer), 0);
+}
+
+// Turn a connection away, the client may try again after retry_ms
+void reject_connection(int socket, const char *reason, int retry_ms)
+{
+    char msg[100];
+    sprintf(msg, "x %s, retry after %d ms\n", reason, retry_ms);
+    send_player(socket, msg, strlen(msg), 0);
+    close_player(socket);
 }
 
 // Cleanup function
 void cleanup_server()
 {
-    if (global_game_manager != NULL)
+    if (handoff_fd > 0)
+    {
+        close(handoff_fd);
+        if (!handed_off)
+        {
+            unlink(handoff_path);
+        }
+    }
+
+    // Searches return right away, queued exports still finish
+    engine_abort();
+    pool_stop();
+    if (bot_results_fd > 0)
+    {
+        engine_stop();
+    }
+    if (export_results_fd > 0)
+    {
+        export_stop();
+    }
+    book_close(&book);
+    if (events_enabled)
+    {
+        EventMetrics metrics;
+        metrics_stop(&metrics);
+        long consumed = metrics.moves + metrics.games_ended;
+        printf("Events: %ld moves (%ld captures), %ld games ended, %ld dropped, %ld batches, "
+               "latency %.1f us average, %.1f us max\n",
+               metrics.moves, metrics.captures, metrics.games_ended, events_dropped, metrics.batches,
+               consumed > 0 ? metrics.total_latency_us / consumed : 0.0, metrics.max_latency_us);
+        spsc_destroy(&game_events);
+        events_enabled = 0;
+    }
+    if (archive_fd >= 0)
+    {
+        close(archive_fd);
+    }
+    if (tablebase_count > 0)
+    {
+        TablebaseStats stats;
+        tablebase_stats(&stats);
+        printf("Tablebase: %ld probes, %ld cache hits, %ld misses\n",
+               stats.probes, stats.cache_hits, stats.cache_misses);
+        tablebase_close();
+    }
+
+    // After a handoff the players belong to the new process
+    if (global_game_manager != NULL && !handed_off)
     {
         // Close all active game connections
         for (int i = 0; i < MAX_GAMES; i++)
@@ -48,26 +306,46 @@ void cleanup_server()
             {
                 if (global_game_manager->games[i].player1_socket > 0)
                 {
-                    send(global_game_manager->games[i].player1_socket,
+                    send_player(global_game_manager->games[i].player1_socket,
                          "Server shutting down. Game over.\n", 32, 0);
-                    close(global_game_manager->games[i].player1_socket);
+                    close_player(global_game_manager->games[i].player1_socket);
                 }
                 if (global_game_manager->games[i].player2_socket > 0)
                 {
-                    send(global_game_manager->games[i].player2_socket,
+                    send_player(global_game_manager->games[i].player2_socket,
                          "Server shutting down. Game over.\n", 32, 0);
-                    close(global_game_manager->games[i].player2_socket);
+                    close_player(global_game_manager->games[i].player2_socket);
                 }
             }
         }
     }
+    if (!handed_off)
+    {
+        for (int i = 0; i < waiting_room.count; i++)
+        {
+            reject_connection(waiting_room.players[i].socket, "Server shutting down", full_retry_ms);
+        }
+
+        // Tournament players between games, the others were closed with their game
+        for (int i = 0; i < tournament.player_count; i++)
+        {
+            TournamentPlayer *player = &tournament.players[i];
+            if (player->socket >= 0 && player->game < 0)
+            {
+                send_player(player->socket, "Server shutting down. Game over.\n", 32, 0);
+                close_player(player->socket);
+            }
+        }
+    }
+    tournament_destroy(&tournament);
+
     // Close server socket
     if (server_fd > 0)
     {
         close(server_fd);
     }
 
-    printf("Server shutdown complete.\n");
+    printf(handed_off ? "Server handed off.\n" : "Server shutdown complete.\n");
 }
 
 // Initialize the game manager
@@ -80,6 +358,9 @@ void init_game_manager(GameManager *gm)
         gm->games[i].player2_socket = -1;
         gm->games[i].is_active = 0;
         gm->games[i].game_id = i;
+        gm->games[i].bot_player = 0;
+        strcpy(gm->games[i].start_fen, START_FEN);
+        history_init(&gm->games[i].history);
     }
 }
 
@@ -96,211 +377,330 @@ int find_available_game(GameManager *gm)
     return -1;
 }
 
-// Find game by socket
-ChessGame *find_game_by_socket(GameManager *gm, int socket)
+// Tables indexed by socket, sized by the descriptor limit
+void init_socket_tables(void)
 {
-    for (int i = 0; i < MAX_GAMES; i++)
+    struct rlimit limit;
+    socket_slots = 1 << 20;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)socket_slots)
     {
-        if (gm->games[i].is_active &&
-            (gm->games[i].player1_socket == socket ||
-             gm->games[i].player2_socket == socket))
-        {
-            return &gm->games[i];
-        }
+        socket_slots = limit.rlim_cur;
+    }
+    socket_games = malloc(sizeof(int) * socket_slots);
+    socket_generations = calloc(socket_slots, sizeof(unsigned));
+    socket_ips = calloc(socket_slots, sizeof(unsigned));
+    if (socket_games == NULL || socket_generations == NULL || socket_ips == NULL ||
+        ip_table_init(&ip_counts, socket_slots) < 0)
+    {
+        perror("socket tables");
+        exit(1);
+    }
+    for (int i = 0; i < socket_slots; i++)
+    {
+        socket_games[i] = -1;
     }
-    return NULL;
 }
 
-// Initialize the chess board
-void init_board(ChessGame *game)
+// Remember the game a player socket was seated in. Entries are not removed
+// when a game ends, lookups check them against the game.
+void index_socket(int socket, int game_idx)
 {
-    // Initialize pieces (simplified version)
-    // First row for black pieces
-    game->board[0][0] = 'r'; // rook
-    game->board[0][1] = 'n'; // knight
-    game->board[0][2] = 'b'; // bishop
-    game->board[0][3] = 'q'; // queen
-    game->board[0][4] = 'k'; // king
-    game->board[0][5] = 'b';
-    game->board[0][6] = 'n';
-    game->board[0][7] = 'r';
-
-    // Black pawns
-    for (int i = 0; i < 8; i++)
+    if (socket >= 0 && socket < socket_slots)
     {
-        game->board[1][i] = 'p';
+        socket_games[socket] = game_idx;
     }
+}
 
-    // Empty squares
-    for (int i = 2; i < 6; i++)
+// Count the connection against its address until close_player
+void count_connection(int socket, unsigned int ip)
+{
+    if (ip != 0 && socket >= 0 && socket < socket_slots)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            game->board[i][j] = '.';
-        }
+        socket_ips[socket] = ip;
+        ip_table_add(&ip_counts, ip);
     }
+}
 
-    // White pawns
-    for (int i = 0; i < 8; i++)
+// Find game by socket
+ChessGame *find_game_by_socket(GameManager *gm, int socket)
+{
+    if (socket < 0 || socket >= socket_slots || socket_games[socket] < 0)
     {
-        game->board[6][i] = 'P';
+        return NULL;
     }
+    ChessGame *game = &gm->games[socket_games[socket]];
+    if (game->is_active && (game->player1_socket == socket || game->player2_socket == socket))
+    {
+        return game;
+    }
+    return NULL;
+}
 
-    // Last row for white pieces
-    game->board[7][0] = 'R';
-    game->board[7][1] = 'N';
-    game->board[7][2] = 'B';
-    game->board[7][3] = 'Q';
-    game->board[7][4] = 'K';
-    game->board[7][5] = 'B';
-    game->board[7][6] = 'N';
-    game->board[7][7] = 'R';
-
-    game->current_player = 1; // White starts
-
-    Tile white;
-    white.col = 4;
-    white.row = 7;
-    game->white_king = white;
+// Initialize the chess board from the starting position
+void init_board(ChessGame *game)
+{
+    copy_position(game, &start_position);
+    memcpy(game->start_fen, start_position.start_fen, FEN_MAX_LENGTH);
+    game->book_plies = 0;
+    game->tablebase_told = TB_NOT_TOLD;
+}
 
-    Tile black;
-    black.col = 4;
-    black.row = 0;
-    game->black_king = black;
+// Write the board message into buffer, returns its length
+int format_board(ChessGame *game, char *buffer)
+{
+    int pos = sprintf(buffer, "\nGame #%d\nboard ", game->game_id);
+    for (int i = 0; i < 8; i++)
+    {
+        memcpy(buffer + pos, game->board[i], 8);
+        pos += 8;
+        buffer[pos++] = '\n';
+    }
+    return pos;
 }
 
-// Send the current board state to a player
+// Send the current board state to a player in a single write
 void send_board(int socket, ChessGame *game)
 {
     char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
-
-    sprintf(buffer, "\nGame #%d\n", game->game_id);
-    send(socket, buffer, strlen(buffer), 0);
+    send_player(socket, buffer, format_board(game, buffer), 0);
+}
 
-    memset(buffer, 0, BUFFER_SIZE);
-    sprintf(buffer, "board ");
-    int pos = 6;
-    for (int i = 0; i < 8; i++)
+// Tell the player why the move was rejected
+void report_invalid_move(int socket, ChessGame *game, MoveStatus status)
+{
+    send_error(socket, move_status_message(status));
+    if (status == MOVE_KING_EXPOSED)
     {
-        for (int j = 0; j < 8; j++)
-        {
-            buffer[pos++] = game->board[i][j];
-        }
-        buffer[pos++] = '\n';
+        send_board(socket, game);
+    }
+    else if (status != MOVE_OWN_PIECE)
+    {
+        send_error(socket, "This move is illegal");
     }
-    send(socket, buffer, strlen(buffer), 0);
 }
 
-Move convert(char *move)
+// Append a game that ended to the archive, when there is one. A worker
+// writes it; only when the pool can not take it the network thread does.
+void archive_game(ChessGame *game, int result)
 {
-    Move move_obj;
-
-    move_obj.from_col = move[0] - 'a';
-    move_obj.from_row = '8' - move[1];
-    move_obj.to_col = move[2] - 'a';
-    move_obj.to_row = '8' - move[3];
+    if (archive_fd < 0 || game->history.count == 0)
+    {
+        return;
+    }
+    if (archive_request(archive_fd, game, result) < 0 && archive_write_game(archive_fd, game, result) < 0)
+    {
+        printf("Could not archive game %d\n", game->game_id);
+    }
+}
 
-    return move_obj;
+// Hand an event to the service threads, dropped when they fall behind so
+// the game loop never waits for them
+void publish_event(int type, ChessGame *game, PackedMove move, char captured, int result)
+{
+    if (!events_enabled)
+    {
+        return;
+    }
+    GameEvent event;
+    event.time_ns = event_clock_ns();
+    event.game_id = game->game_id;
+    event.ply = game->history.count;
+    event.move = move;
+    event.type = type;
+    event.captured = captured;
+    event.result = result;
+    if (spsc_push(&game_events, &event) < 0)
+    {
+        events_dropped++;
+    }
 }
 
-// Helper functions to make the code more readable
+// Everything that happens when a game ends, before its history is released
+void record_game_end(ChessGame *game, int result)
+{
+    archive_game(game, result);
+    publish_event(EVENT_GAME_END, game, 0, '.', result);
+}
 
-int verify_move(int socket, ChessGame *game, Move *move)
+// Score a finished tournament game, its players stay connected for the next
+// round. Returns 0 when the game is not part of the tournament.
+int end_tournament_game(ChessGame *game, int white_points)
 {
-    char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
-    // check boundaries
-    if (move->from_col < 0 || move->from_col > 7 || move->from_row < 0 || move->from_row > 7 ||
-        move->to_col < 0 || move->to_col > 7 || move->to_row < 0 || move->to_row > 7)
+    int white = tournament_find(&tournament, game->player1_socket);
+    int black = tournament_find(&tournament, game->player2_socket);
+    if (white < 0 || black < 0 || tournament.players[white].game != game->game_id)
     {
-        send_error(socket, "Invalid move coordinates!");
         return 0;
     }
+    tournament_record(&tournament, white, black, white_points);
+    tournament_games--;
 
-    if (move->from_col == move->to_col && move->from_row == move->to_row)
+    const char *outcomes[3] = {"black wins", "draw", "white wins"};
+    char msg[100];
+    if (tournament.round < tournament.rounds)
     {
-        // send(socket, "You have to make a move!\n", 24, 0);
-        send_error(socket, "You have to make a move!");
-        return 0;
+        sprintf(msg, "Game #%d over: %s. Waiting for round %d...\n",
+                game->game_id, outcomes[white_points], tournament.round + 1);
     }
+    else
+    {
+        sprintf(msg, "Game #%d over: %s. Waiting for the final standings...\n",
+                game->game_id, outcomes[white_points]);
+    }
+    send_player(game->player1_socket, msg, strlen(msg), 0);
+    send_player(game->player2_socket, msg, strlen(msg), 0);
+    return 1;
+}
 
-    char piece = game->board[move->from_row][move->from_col];
-
-    if (piece == '.')
+void finish_game(ChessGame *game, int winner)
+{
+    record_game_end(game, winner ? ARCHIVE_WHITE_WINS : ARCHIVE_BLACK_WINS);
+    game->is_active = 0;
+    history_clear(&game->history);
+    global_game_manager->active_games--;
+    if (end_tournament_game(game, winner ? 2 : 0))
     {
-        send_error(socket, "You have to move an existing piece!");
-        return 0;
+        return;
+    }
+    int winner_socket = winner ? game->player1_socket : game->player2_socket;
+    int loser_socket = winner ? game->player2_socket : game->player1_socket;
+    if (winner_socket > 0)
+    {
+        send_player(winner_socket, "x You win! Game over.\n", 23, 0);
+        close_player(winner_socket);
+    }
+    if (loser_socket > 0)
+    {
+        send_player(loser_socket, "x You lost. Game over.\n", 24, 0);
+        close_player(loser_socket);
     }
+}
 
-    int is_player1 = (socket == game->player1_socket);
+// Write a move in the notation players use, e.g. "e2e4"
+void format_move(Move *move, char *text)
+{
+    text[0] = 'a' + move->from_col;
+    text[1] = '8' - move->from_row;
+    text[2] = 'a' + move->to_col;
+    text[3] = '8' - move->to_row;
+    text[4] = '\0';
+}
+
+int play_move(ChessGame *game, int socket, char *move);
 
-    // check if player white moves black pieces
-    if (is_player1 && piece > 96)
+void finish_drawn_game(ChessGame *game)
+{
+    record_game_end(game, ARCHIVE_DRAW);
+    game->is_active = 0;
+    history_clear(&game->history);
+    global_game_manager->active_games--;
+    if (end_tournament_game(game, 1))
     {
-        send_error(socket, "You can't move black's pieces!");
-        return 0;
+        return;
+    }
+    if (game->player1_socket > 0)
+    {
+        send_player(game->player1_socket, "x Draw. Game over.\n", 19, 0);
+        close_player(game->player1_socket);
+    }
+    if (game->player2_socket > 0)
+    {
+        send_player(game->player2_socket, "x Draw. Game over.\n", 19, 0);
+        close_player(game->player2_socket);
     }
+}
 
-    if (!is_player1 && piece < 96)
+// Tell the players the endgame table result of the position, and end the
+// game when adjudication is on. Returns 1 when the game was ended.
+int probe_tablebase(ChessGame *game)
+{
+    TablebaseResult result;
+    if (tablebase_count == 0 || !game->is_active || !tablebase_probe(game, &result))
     {
-        send_error(socket, "You can't move white's pieces!");
         return 0;
     }
 
-    char lower_piece = tolower(piece);
+    char msg[100];
+    int white_wins = (result.result > 0) == (game->current_player == 1);
+    if (result.result == 0)
+    {
+        sprintf(msg, "Tablebase: draw\n");
+    }
+    else
+    {
+        sprintf(msg, "Tablebase: %s mates in %d\n", white_wins ? "white" : "black", (result.plies + 1) / 2);
+    }
 
-    if (lower_piece == 'p' && is_pawn_takes_move_validation(move))
+    // Players hear the result when it changes, not the countdown every move
+    int told = result.result == 0 ? 0 : white_wins ? 1 : -1;
+    if (told != game->tablebase_told)
     {
-        return is_pawn_takes(is_player1, move, game->board);
+        game->tablebase_told = told;
+        send_player(game->player1_socket, msg, strlen(msg), 0);
+        send_player(game->player2_socket, msg, strlen(msg), 0);
     }
 
-    if (!check_validity(tolower(lower_piece), move))
+    if (!tablebase_adjudicate)
     {
-        send_error(socket, "This move cannot be played by this piece!");
         return 0;
     }
-
+    printf("Game %d adjudicated by tablebase: %s", game->game_id, msg + 11);
+    if (result.result == 0)
+    {
+        finish_drawn_game(game);
+    }
+    else
+    {
+        finish_game(game, white_wins);
+    }
     return 1;
 }
 
-int apply_move(Move *move, char board[8][8])
+// Ask the engine for a move when it is its turn, positions still in the
+// opening book are answered from the book right away. A request the pool
+// refused is queued for retry_bot_moves.
+void request_bot_move(ChessGame *game)
 {
-    char piece_taken = board[move->to_row][move->to_col];
-    board[move->to_row][move->to_col] = board[move->from_row][move->from_col];
-    board[move->from_row][move->from_col] = '.';
-    return piece_taken;
-}
+    if (!game->is_active || game->bot_player != game->current_player || bot_results_fd < 0)
+    {
+        return;
+    }
 
-void revert_move(Move *move, char board[8][8], char piece_taken)
-{
-    board[move->from_row][move->from_col] = board[move->to_row][move->to_col];
-    board[move->to_row][move->to_col] = piece_taken;
+    Move book_move;
+    if (book.count > 0 && game->book_plies == game->history.count && book_choose(&book, game, &book_move))
+    {
+        char move[5];
+        format_move(&book_move, move);
+        play_move(game, BOT_SOCKET, move);
+        return;
+    }
+
+    game->bot_ticket = ++bot_tickets;
+    if (engine_request(game, game->bot_ticket, &bot_limits) < 0 && !bot_retry_queued[game->game_id])
+    {
+        printf("Engine queue full, game %d retries when a search finishes\n", game->game_id);
+        bot_retry_queued[game->game_id] = 1;
+        bot_retries[bot_retry_count++] = game->game_id;
+    }
 }
 
-void finish_game(ChessGame *game, int winner)
+// Request again the moves the pool refused, games that ended or where it is
+// no longer the engine's turn just leave the list
+void retry_bot_moves(GameManager *gm)
 {
-    game->is_active = 0;
-    int winner_socket = winner ? game->player1_socket : game->player2_socket;
-    int loser_socket = winner ? game->player2_socket : game->player1_socket;
-    send(winner_socket, "x You win! Game over.\n", 23, 0);
-    close(winner_socket);
-    send(loser_socket, "x You lost. Game over.\n", 24, 0);
-    close(loser_socket);
+    int count = bot_retry_count;
+    bot_retry_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        bot_retry_queued[bot_retries[i]] = 0;
+        request_bot_move(&gm->games[bot_retries[i]]);
+    }
 }
 
-// Handle moves
-int handle_move(int socket, GameManager *gm, char *move)
+// Play a move for the player on the given socket
+int play_move(ChessGame *game, int socket, char *move)
 {
-    char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
-    ChessGame *game = find_game_by_socket(gm, socket);
     Move move_obj = convert(move);
-    if (!game)
-    {
-        send(socket, "Game not found!\n", 15, 0);
-        return 0;
-    }
 
     // Check if it's this player's turn
     int is_player1 = (socket == game->player1_socket);
@@ -319,53 +719,61 @@ int handle_move(int socket, GameManager *gm, char *move)
         return 0;
     }
 
-    // Basic boundary check
-    if (!verify_move(socket, game, &move_obj))
+    // Validate the move against the rules
+    MoveStatus status = validate_move(game, &move_obj, is_player1);
+    if (status != MOVE_VALID)
     {
-        send_error(socket, "This move is illegal");
+        if (status == MOVE_KING_EXPOSED)
+        {
+            printf("%s checked!\n", is_player1 ? "white" : "black");
+        }
+        report_invalid_move(socket, game, status);
         return 0;
-    };
+    }
 
     printf("before: %c, after: %c\n", game->board[move_obj.from_row][move_obj.from_col], game->board[move_obj.to_row][move_obj.to_col]);
+    // Only a game that followed the book so far can still be in it
+    int from_book = book.count > 0 && game->book_plies == game->history.count &&
+                    book_contains(&book, game, &move_obj);
+
     // Make the move
     move_king(game, &move_obj);
-
     char piece_taken = apply_move(&move_obj, game->board);
+    update_position_state(game, &move_obj, game->board[move_obj.to_row][move_obj.to_col], piece_taken);
 
-    int is_piece_taken_black = piece_taken > 96;
+    printf("checking for checks for player: %s\n", !is_player1 ? "white" : "black");
+    int checked = is_king_checked(game, !is_player1);
+    int mated = checked && is_checkmate(game, &move_obj, is_player1);
 
-    if (piece_taken != '.' && is_player1 != is_piece_taken_black)
+    int flags = piece_taken != '.' ? MOVE_FLAG_CAPTURE : 0;
+    PackedMove packed = pack_move(&move_obj, 0, flags);
+    if (history_push(&game->history, packed, piece_taken) < 0)
     {
-        revert_move(&move_obj, game->board, piece_taken);
-        send_error(socket, "You can't take your own pieces!");
-        return 0;
+        printf("Out of memory for the history of game %d\n", game->game_id);
     }
-
-    printf("checking for checks for player: %s\n", is_player1 ? "white" : "black");
-    if (is_king_checked(game, is_player1))
+    else
     {
-        printf("%s checked!\n", is_player1 ? "white" : "black");
-        revert_move(&move_obj, game->board, piece_taken);
-        send_error(socket, "This move is illegal as this piece is protecting your king from check");
-        send_board(socket, game);
-        return 0;
+        history_set_state(&game->history, (checked ? MOVE_CHECK : 0) | (mated ? MOVE_MATE : 0));
+        if (from_book)
+        {
+            game->book_plies++;
+            printf("Book move %s in game %d\n", move, game->game_id);
+        }
     }
+    publish_event(EVENT_MOVE, game, packed, piece_taken, 0);
 
-    printf("checking for checks for player: %s\n", !is_player1 ? "white" : "black");
-    if (is_king_checked(game, !is_player1))
+    if (checked)
     {
         printf("%s checked!\n", !is_player1 ? "white" : "black");
-        int a = can_king_be_moved(game, !is_player1);
-        int b = can_be_taken(game, &move_obj, is_player1);
-        int c = can_be_blocked(game, &move_obj, !is_player1);
-        if (!a && !b && !c)
+        if (mated)
         {
             send_board(game->player1_socket, game);
             send_board(game->player2_socket, game);
             finish_game(game, is_player1);
+            return 1;
         }
-        send(game->player1_socket, "Check!\n", 8, 0);
-        send(game->player2_socket, "Check!\n", 8, 0);
+        send_player(game->player1_socket, "Check!\n", 8, 0);
+        send_player(game->player2_socket, "Check!\n", 8, 0);
     }
 
     // Switch turns
@@ -375,61 +783,1580 @@ int handle_move(int socket, GameManager *gm, char *move)
     send_board(game->player1_socket, game);
     send_board(game->player2_socket, game);
 
+    if (probe_tablebase(game))
+    {
+        return 1;
+    }
+    request_bot_move(game);
     return 1;
 }
 
-void parse_args(int argc, char **argv)
+// Handle moves
+int handle_move(int socket, GameManager *gm, char *move)
 {
-    if (argc < 1)
+    ChessGame *game = find_game_by_socket(gm, socket);
+    if (!game)
     {
-        printf("usage: %s -p PORT\n", argv[0]);
-        printf("OPTIONS\n");
-        printf("  -p --port    PORT\n");
-        exit(1);
+        send_player(socket, "Game not found!\n", 15, 0);
+        return 0;
     }
+    return play_move(game, socket, move);
+}
 
-    for (int i = 1; i < argc - 1; i++)
+// Send the current position as FEN
+void send_fen(int socket, GameManager *gm)
+{
+    ChessGame *game = find_game_by_socket(gm, socket);
+    if (!game)
     {
-        if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0)
-        {
-            port = atoi(argv[++i]);
-        }
+        send_player(socket, "Game not found!\n", 15, 0);
+        return;
     }
+
+    char buffer[BUFFER_SIZE];
+    char fen[FEN_MAX_LENGTH];
+    write_fen(game, fen, FEN_MAX_LENGTH);
+    sprintf(buffer, "fen %s\n", fen);
+    send_player(socket, buffer, strlen(buffer), 0);
 }
 
-int main(int argc, char **argv)
+// Start the game from another position, only White can do it and only
+// while waiting for an opponent
+void start_from_fen(int socket, GameManager *gm, const char *fen)
 {
-    setbuf(stdout, NULL); // Add this line at the start of main
-    parse_args(argc, argv);
+    ChessGame *game = find_game_by_socket(gm, socket);
+    if (!game)
+    {
+        send_player(socket, "Game not found!\n", 15, 0);
+        return;
+    }
+    if (socket != game->player1_socket || game->player2_socket != -1)
+    {
+        send_error(socket, "The position can only be set by White before the game starts");
+        return;
+    }
+    if (load_fen(game, fen) != 0)
+    {
+        send_error(socket, "Invalid FEN");
+        return;
+    }
+    write_fen(game, game->start_fen, FEN_MAX_LENGTH);
+    history_clear(&game->history);
+    game->book_plies = 0;
+    game->tablebase_told = TB_NOT_TOLD;
+    send_board(socket, game);
+}
 
-    int server_fd, new_socket;
-    struct sockaddr_in address;
-    int opt = 1;
-    int addrlen = sizeof(address);
-    GameManager game_manager;
-    fd_set readfds;
-    char buffer[BUFFER_SIZE];
+// Send the moves played so far as PGN, the replay runs on a worker and
+// handle_export_results sends the text
+void send_pgn(int socket, GameManager *gm)
+{
+    ChessGame *game = find_game_by_socket(gm, socket);
+    if (!game)
+    {
+        send_player(socket, "Game not found!\n", 15, 0);
+        return;
+    }
 
-    global_game_manager = &game_manager;
+    if (export_request(game, socket, "Player White", game->bot_player ? "Engine" : "Player Black") < 0)
+    {
+        send_error(socket, "Could not export the game");
+    }
+}
+
+// Send the PGN exports the workers finished
+void handle_export_results(GameManager *gm)
+{
+    ExportResult result;
+    while (export_read_result(&result))
+    {
+        // The player may have left while the game was exported
+        ChessGame *game = &gm->games[result.game_id];
+        if (game->is_active && (game->player1_socket == result.socket || game->player2_socket == result.socket))
+        {
+            if (result.pgn == NULL)
+            {
+                send_error(result.socket, "Could not export the game");
+            }
+            else
+            {
+                send_player(result.socket, "pgn\n", 4, 0);
+                send_player(result.socket, result.pgn, strlen(result.pgn), 0);
+            }
+        }
+        free(result.pgn);
+    }
+}
+
+// Send the probe count, cache hit rate and probe latency of the tablebases
+void send_tablebase_stats(int socket)
+{
+    TablebaseStats stats;
+    char buffer[BUFFER_SIZE];
+    tablebase_stats(&stats);
+    sprintf(buffer, "tb %d tables, %ld probes, %.1f%% cache hits, %.2f us per probe\n",
+            tablebase_count, stats.probes,
+            stats.probes > 0 ? stats.cache_hits * 100.0 / stats.probes : 0.0,
+            stats.probes > 0 ? stats.total_us / stats.probes : 0.0);
+    send_player(socket, buffer, strlen(buffer), 0);
+}
+
+#ifdef DEBUG
+// Memory of the games, their connections and the whole process, to size
+// hosts by the number of games
+void send_memory_stats(int socket, GameManager *gm)
+{
+    GameFootprint games;
+    ProcessFootprint process;
+    char buffer[BUFFER_SIZE];
+    int pos = 0;
+
+    game_footprint(gm, &games);
+    process_footprint(&process);
+    size_t events = events_enabled ? (game_events.mask + 1) * sizeof(GameEvent) : 0;
+
+    pos += sprintf(buffer + pos, "mem games: %ld slots, %ld active, %.1f KB, %lu bytes per slot\n",
+                   games.game_slots, games.active_games, games.game_bytes / 1024.0,
+                   (unsigned long)(games.game_bytes / games.game_slots));
+    pos += sprintf(buffer + pos, "mem history: %ld chunks in use of %ld allocated, %.1f KB\n",
+                   games.history_chunks, games.pool_chunks, games.history_bytes / 1024.0);
+    pos += sprintf(buffer + pos, "mem connections: %ld, %.1f KB socket buffer limits, %lu bytes queued\n",
+                   games.connections, games.socket_buffer_bytes / 1024.0, (unsigned long)games.queued_bytes);
+    pos += sprintf(buffer + pos, "mem idle game: %lu bytes\n", (unsigned long)idle_game_bytes(&games));
+    size_t sockets = socket_slots * (sizeof(int) + 2 * sizeof(unsigned) +
+                                     (uring_active ? sizeof(RingSocket) + sizeof(int) : 0)) +
+                     (ip_counts.mask + 1) * sizeof(IpCount);
+    pos += sprintf(buffer + pos, "mem other: waiting room %.1f KB, tournament %.1f KB, event ring %.1f KB, "
+                                 "book %.1f KB mapped, socket tables %.1f KB\n",
+                   waiting_room.capacity * sizeof(WaitingPlayer) / 1024.0, tournament_memory(&tournament) / 1024.0,
+                   events / 1024.0, book.count > 0 ? book.size / 1024.0 : 0.0, sockets / 1024.0);
+    pos += sprintf(buffer + pos, "mem process: rss %.1f KB, peak %.1f KB, heap %.1f KB (%.1f KB in use, %.1f KB free)\n",
+                   process.rss_bytes / 1024.0, process.peak_rss_bytes / 1024.0, process.heap_bytes / 1024.0,
+                   process.heap_in_use / 1024.0, process.heap_free / 1024.0);
+    send_player(socket, buffer, pos, 0);
+}
+#endif
+
+// Dispatch a message from a player, everything that is not a command is a move
+int handle_message(int socket, GameManager *gm, char *message)
+{
+    if (strcmp(message, "fen") == 0)
+    {
+        send_fen(socket, gm);
+        return 1;
+    }
+    if (strncmp(message, "new ", 4) == 0)
+    {
+        start_from_fen(socket, gm, message + 4);
+        return 1;
+    }
+    if (strcmp(message, "pgn") == 0)
+    {
+        send_pgn(socket, gm);
+        return 1;
+    }
+    if (strcmp(message, "tb") == 0)
+    {
+        send_tablebase_stats(socket);
+        return 1;
+    }
+#ifdef DEBUG
+    if (strcmp(message, "mem") == 0)
+    {
+        send_memory_stats(socket, gm);
+        return 1;
+    }
+#endif
+    return handle_move(socket, gm, message);
+}
+
+void parse_args(int argc, char **argv)
+{
+    if (argc < 1)
+    {
+        printf("usage: %s -p PORT\n", argv[0]);
+        printf("OPTIONS\n");
+        printf("  -p --port    PORT\n");
+        printf("  -f --fen     FEN   starting position of new games\n");
+        printf("  -e --events  select|epoll|uring\n");
+        printf("  --max-per-ip CONNECTIONS  connections per address, 0 for no limit\n");
+        printf("  --accept-rate RATE  new connections per second\n");
+        printf("  --accept-burst CONNECTIONS  connections accepted at once\n");
+        printf("  --waiting-room PLAYERS  players waiting for a free game\n");
+        printf("  --retry-after MS  retry hint sent when the server is full\n");
+        printf("  --book       FILE  opening book made with mkbook\n");
+        printf("  --tablebases DIRECTORY  endgame tables made with mktb\n");
+        printf("  --tb-mode    announce|adjudicate  tell players the table result or end the game\n");
+        printf("  --archive    FILE  append finished games to FILE for replay\n");
+        printf("  --event-queue SIZE  publish game events to the metrics service through a ring of SIZE\n");
+        printf("  --tournament ROUNDS  Swiss tournament instead of pairing players as they arrive\n");
+        printf("  --tournament-players PLAYERS  registrations that start the first round\n");
+        printf("  --round-time SECONDS  unfinished games of a round are drawn after SECONDS\n");
+        printf("  --handoff    PATH  accept a takeover by a restarted server on PATH\n");
+        printf("  --takeover   PATH  take over the server listening on PATH\n");
+        printf("  --bot-after  SECONDS  engine plays black after a player waited SECONDS\n");
+        printf("  --bot-time   MS    engine time budget per move\n");
+        printf("  --bot-nodes  NODES engine node budget per move, 0 for no limit\n");
+        printf("  --bot-threads THREADS  worker threads for the engine and PGN exports\n");
+        exit(1);
+    }
+
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--port") == 0)
+        {
+            port = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--events") == 0)
+        {
+            i++;
+            if (strcmp(argv[i], "select") == 0)
+            {
+                event_backend = EVENTS_SELECT;
+            }
+            else if (strcmp(argv[i], "epoll") == 0)
+            {
+                event_backend = EVENTS_EPOLL;
+            }
+            else if (strcmp(argv[i], "uring") == 0)
+            {
+                event_backend = EVENTS_URING;
+            }
+            else
+            {
+                printf("Unknown event backend: %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--bot-after") == 0)
+        {
+            bot_after = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bot-time") == 0)
+        {
+            bot_limits.time_ms = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bot-nodes") == 0)
+        {
+            bot_limits.max_nodes = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bot-threads") == 0)
+        {
+            bot_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-per-ip") == 0)
+        {
+            max_per_ip = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--accept-rate") == 0)
+        {
+            accept_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--accept-burst") == 0)
+        {
+            accept_burst = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--waiting-room") == 0)
+        {
+            waiting_room_size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--retry-after") == 0)
+        {
+            full_retry_ms = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--book") == 0)
+        {
+            book_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tablebases") == 0)
+        {
+            tablebase_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--event-queue") == 0)
+        {
+            event_queue_size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--archive") == 0)
+        {
+            archive_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tb-mode") == 0)
+        {
+            i++;
+            if (strcmp(argv[i], "announce") == 0)
+            {
+                tablebase_adjudicate = 0;
+            }
+            else if (strcmp(argv[i], "adjudicate") == 0)
+            {
+                tablebase_adjudicate = 1;
+            }
+            else
+            {
+                printf("Unknown tablebase mode: %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--tournament") == 0)
+        {
+            tournament_rounds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tournament-players") == 0)
+        {
+            tournament_players = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--round-time") == 0)
+        {
+            round_time = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--handoff") == 0)
+        {
+            handoff_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--takeover") == 0)
+        {
+            takeover_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--fen") == 0)
+        {
+            ChessGame game;
+            start_fen = argv[++i];
+            if (load_fen(&game, start_fen) != 0)
+            {
+                printf("Invalid FEN: %s\n", start_fen);
+                exit(1);
+            }
+        }
+    }
+}
+
+// Put the player into a game, pairing with a waiting player when there is
+// one. Returns the game index or -1 when every game is taken.
+int seat_player(GameManager *gm, int new_socket, unsigned int ip)
+{
+    // Find or create a game for the new player
+    int game_idx = -1;
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        if (gm->games[i].is_active &&
+            gm->games[i].player2_socket == -1)
+        {
+            game_idx = i;
+            break;
+        }
+    }
+
+    if (game_idx == -1)
+    {
+        game_idx = find_available_game(gm);
+        if (game_idx == -1)
+        {
+            return -1;
+        }
+
+        // Initialize new game
+        gm->games[game_idx].is_active = 1;
+        gm->games[game_idx].player1_socket = new_socket;
+        gm->games[game_idx].player1_ip = ip;
+        index_socket(new_socket, game_idx);
+        gm->games[game_idx].player2_socket = -1;
+        gm->games[game_idx].bot_player = 0;
+        gm->games[game_idx].waiting_since = time(NULL);
+        history_clear(&gm->games[game_idx].history);
+        init_board(&gm->games[game_idx]);
+        gm->active_games++;
+
+        char msg[100];
+        sprintf(msg, "Welcome! You are Player White in Game #%d. Waiting for opponent...\n",
+                game_idx);
+        send_player(new_socket, msg, strlen(msg), 0);
+        send_board(new_socket, &gm->games[game_idx]);
+    }
+    else
+    {
+        // Add second player to existing game
+        gm->games[game_idx].player2_socket = new_socket;
+        gm->games[game_idx].player2_ip = ip;
+        index_socket(new_socket, game_idx);
+        char msg[100];
+        sprintf(msg, "Welcome! You are Player Black in Game #%d\n", game_idx);
+        send_player(new_socket, msg, strlen(msg), 0);
+        send_board(new_socket, &gm->games[game_idx]);
+
+        // Notify both players that game is starting
+        sprintf(msg, "Game #%d is starting!\n", game_idx);
+        send_player(gm->games[game_idx].player1_socket, msg, strlen(msg), 0);
+        send_player(gm->games[game_idx].player2_socket, msg, strlen(msg), 0);
+    }
+
+    return game_idx;
+}
+
+double elapsed_ms(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+// Send every player the final standings and close the connections,
+// registration for the next tournament opens right away
+void finish_tournament(void)
+{
+    int count = tournament_standings(&tournament);
+    printf("Tournament over after %d rounds, %d players\n", tournament.round, count);
+    for (int place = 0; place < count; place++)
+    {
+        TournamentPlayer *player = &tournament.players[tournament.order[place]];
+        if (place < 3)
+        {
+            printf("  %d. player #%d, %d.%d points\n", place + 1, tournament.order[place] + 1,
+                   player->points / 2, player->points % 2 * 5);
+        }
+        if (player->socket < 0)
+        {
+            continue;
+        }
+        char msg[100];
+        sprintf(msg, "x Tournament over: place %d of %d with %d.%d points\n",
+                place + 1, count, player->points / 2, player->points % 2 * 5);
+        send_player(player->socket, msg, strlen(msg), 0);
+        close_player(player->socket);
+    }
+    tournament_reset(&tournament);
+}
+
+// Score a pairing whose game can not start because a player left. The
+// player still here wins, when both left nobody gets a point.
+void forfeit_tournament_game(TournamentPairing *pairing, TournamentPlayer *white, TournamentPlayer *black)
+{
+    if (white->socket < 0 && black->socket < 0)
+    {
+        return;
+    }
+    TournamentPlayer *winner = white->socket >= 0 ? white : black;
+    tournament_record(&tournament, pairing->white, pairing->black, winner == white ? 2 : 0);
+
+    char msg[100];
+    int len = sprintf(msg, "Tournament round %d of %d: your opponent left, you win by forfeit\n",
+                      tournament.round, tournament.rounds);
+    send_player(winner->socket, msg, len, MSG_DONTWAIT);
+}
+
+// Start the games of the next pairings, at most TOURNAMENT_START_BATCH per
+// call so the network loop keeps serving moves while a large round starts.
+// Every player gets the pairing, board and start notice in one write.
+void start_tournament_games(GameManager *gm)
+{
+    struct timespec start;
+    char buffer[BUFFER_SIZE];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int end = tournament_next + TOURNAMENT_START_BATCH;
+    if (end > tournament.pairing_count)
+    {
+        end = tournament.pairing_count;
+    }
+    for (; tournament_next < end; tournament_next++)
+    {
+        TournamentPairing *pairing = &tournament.pairings[tournament_next];
+        TournamentPlayer *white = &tournament.players[pairing->white];
+        if (pairing->black < 0)
+        {
+            int len = sprintf(buffer, "Tournament round %d of %d: you have a bye and get a point\n",
+                              tournament.round, tournament.rounds);
+            if (white->socket >= 0)
+            {
+                send_player(white->socket, buffer, len, MSG_DONTWAIT);
+            }
+            continue;
+        }
+        TournamentPlayer *black = &tournament.players[pairing->black];
+
+        // A player who left since the pairing loses by forfeit
+        if (white->socket < 0 || black->socket < 0)
+        {
+            forfeit_tournament_game(pairing, white, black);
+            continue;
+        }
+
+        while (tournament_free_slot < MAX_GAMES && gm->games[tournament_free_slot].is_active)
+        {
+            tournament_free_slot++;
+        }
+        if (tournament_free_slot == MAX_GAMES)
+        {
+            // Checked at startup, only games from before a restart can take the slots
+            printf("No free game for a pairing of round %d, scored as a draw\n", tournament.round);
+            tournament_record(&tournament, pairing->white, pairing->black, 1);
+            continue;
+        }
+
+        ChessGame *game = &gm->games[tournament_free_slot++];
+        game->is_active = 1;
+        game->player1_socket = white->socket;
+        game->player1_ip = white->ip;
+        game->player2_socket = black->socket;
+        game->player2_ip = black->ip;
+        index_socket(white->socket, game->game_id);
+        index_socket(black->socket, game->game_id);
+        game->bot_player = 0;
+        game->waiting_since = time(NULL);
+        history_clear(&game->history);
+        init_board(game);
+        gm->active_games++;
+        white->game = game->game_id;
+        black->game = game->game_id;
+        tournament_games++;
+        round_games++;
+
+        for (int color = 0; color < 2; color++)
+        {
+            int len = sprintf(buffer, "Tournament round %d of %d: you are Player %s in Game #%d\n",
+                              tournament.round, tournament.rounds, color == 0 ? "White" : "Black", game->game_id);
+            len += format_board(game, buffer + len);
+            len += sprintf(buffer + len, "Game #%d is starting!\n", game->game_id);
+            send_player(color == 0 ? white->socket : black->socket, buffer, len, MSG_DONTWAIT);
+        }
+    }
+
+    double slice_ms = elapsed_ms(&start);
+    round_slices++;
+    if (slice_ms > round_slice_ms)
+    {
+        round_slice_ms = slice_ms;
+    }
+    if (tournament_next == tournament.pairing_count)
+    {
+        printf("Tournament round %d of %d: %d games started in %.1f ms, %d slices, longest %.1f ms\n",
+               tournament.round, tournament.rounds, round_games, elapsed_ms(&round_started),
+               round_slices, round_slice_ms);
+    }
+}
+
+// Pair the next round and start its first games, or end the tournament
+// after the last round
+void start_tournament_round(GameManager *gm)
+{
+    clock_gettime(CLOCK_MONOTONIC, &round_started);
+    if (tournament_pair_round(&tournament) == 0)
+    {
+        finish_tournament();
+        return;
+    }
+    tournament_next = 0;
+    tournament_free_slot = 0;
+    round_games = 0;
+    round_slices = 0;
+    round_slice_ms = 0;
+    printf("Tournament round %d of %d: %d pairings in %.1f ms\n",
+           tournament.round, tournament.rounds, tournament.pairing_count, elapsed_ms(&round_started));
+    start_tournament_games(gm);
+}
+
+int tournament_starting(void)
+{
+    return tournament_next < tournament.pairing_count;
+}
+
+// Called on every pass of the network loop: start the next slice of games,
+// draw the games that ran out of round time and pair the next round once
+// every game of this one ended
+void run_tournament(GameManager *gm)
+{
+    if (tournament.round == 0)
+    {
+        return;
+    }
+    if (tournament_starting())
+    {
+        start_tournament_games(gm);
+        return;
+    }
+
+    if (tournament_games > 0 && round_time > 0 && elapsed_ms(&round_started) >= round_time * 1000.0)
+    {
+        printf("Tournament round %d: time is up, %d unfinished games are drawn\n",
+               tournament.round, tournament_games);
+        for (int i = 0; i < tournament.pairing_count; i++)
+        {
+            TournamentPairing *pairing = &tournament.pairings[i];
+            int game = pairing->black < 0 ? -1 : tournament.players[pairing->white].game;
+            if (game >= 0 && tournament.players[pairing->black].game == game && gm->games[game].is_active)
+            {
+                finish_drawn_game(&gm->games[game]);
+            }
+        }
+    }
+    if (tournament_games == 0)
+    {
+        start_tournament_round(gm);
+    }
+}
+
+// In tournament mode players register instead of being paired on arrival,
+// the first round starts once the field is full. Returns the socket, or -1
+// when the connection was turned away.
+int register_tournament_player(GameManager *gm, int socket, unsigned int ip)
+{
+    int player = tournament_register(&tournament, socket, ip);
+    if (player < 0)
+    {
+        reject_connection(socket, "Tournament in progress", full_retry_ms);
+        return -1;
+    }
+
+    char msg[100];
+    sprintf(msg, "Registered for the tournament as player #%d, %d of %d players\n",
+            player + 1, tournament.player_count, tournament.capacity);
+    send_player(socket, msg, strlen(msg), 0);
+    if (tournament.player_count == tournament.capacity)
+    {
+        start_tournament_round(gm);
+    }
+    return socket;
+}
+
+// Players between tournament games only talk to us by leaving
+void handle_tournament_input(int socket, int length)
+{
+    if (length > 0)
+    {
+        send_error(socket, "Wait for your next tournament game");
+        return;
+    }
+    int player = tournament_find(&tournament, socket);
+    printf("Tournament player #%d left\n", player + 1);
+    tournament_withdraw(&tournament, player);
+    close_player(socket);
+}
+
+// Seat a new connection in a game or the waiting room, returns the socket
+// to watch or -1 when the connection was turned away
+int admit_connection(GameManager *gm, int new_socket, unsigned int ip)
+{
+    int retry_ms = accept_rate > 0 ? token_bucket_take(&accept_bucket) : 0;
+    if (retry_ms > 0)
+    {
+        reject_connection(new_socket, "Too many new connections", retry_ms);
+        return -1;
+    }
+
+    // select cannot watch descriptors past FD_SETSIZE
+    if (event_backend == EVENTS_SELECT && new_socket >= FD_SETSIZE)
+    {
+        reject_connection(new_socket, "Server full", full_retry_ms);
+        return -1;
+    }
+
+    if (max_per_ip > 0 && ip_table_count(&ip_counts, ip) >= max_per_ip)
+    {
+        reject_connection(new_socket, "Too many connections from your address", full_retry_ms);
+        return -1;
+    }
+    count_connection(new_socket, ip);
+
+    if (tournament_rounds > 0)
+    {
+        return register_tournament_player(gm, new_socket, ip);
+    }
+
+    if (waiting_room.count == 0 && seat_player(gm, new_socket, ip) != -1)
+    {
+        return new_socket;
+    }
+
+    int place = waiting_room_push(&waiting_room, new_socket, ip);
+    if (place < 0)
+    {
+        reject_connection(new_socket, "Server full", full_retry_ms);
+        return -1;
+    }
+
+    char msg[100];
+    sprintf(msg, "Server full, you are number %d in the waiting room\n", place);
+    send_player(new_socket, msg, strlen(msg), 0);
+    return new_socket;
+}
+
+// Accept a new connection, returns the socket to watch or -1
+int accept_player(GameManager *gm)
+{
+    struct sockaddr_in address;
+    socklen_t addrlen = sizeof(address);
+    int new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen);
+    if (new_socket < 0)
+    {
+        perror("accept");
+        return -1;
+    }
+    return admit_connection(gm, new_socket, address.sin_addr.s_addr);
+}
+
+// Move waiting players into games that became free
+void admit_waiting_players(GameManager *gm)
+{
+    WaitingPlayer player;
+    while (waiting_room.count > 0)
+    {
+        waiting_room_pop(&waiting_room, &player);
+        if (seat_player(gm, player.socket, player.ip) == -1)
+        {
+            // Still full, keep the place at the front of the queue
+            memmove(waiting_room.players + 1, waiting_room.players, sizeof(WaitingPlayer) * waiting_room.count);
+            waiting_room.players[0] = player;
+            waiting_room.count++;
+            return;
+        }
+    }
+}
+
+// Waiting players only talk to us by leaving
+void handle_waiting_input(int socket, int length)
+{
+    if (length <= 0)
+    {
+        waiting_room_remove(&waiting_room, socket);
+        close_player(socket);
+    }
+}
+
+// Handle a message from a player, a failed read means the player left
+void handle_player_input(GameManager *gm, ChessGame *game, int socket, char *buffer, int length)
+{
+    if (length > 0)
+    {
+        buffer[length - 1] = '\0';
+        handle_message(socket, gm, buffer);
+        return;
+    }
+
+    int is_player1 = (socket == game->player1_socket);
+    int opponent = is_player1 ? game->player2_socket : game->player1_socket;
+    printf("Player %d disconnected from game %d\n", is_player1 ? 1 : 2, game->game_id);
+    record_game_end(game, ARCHIVE_ABORTED);
+    history_clear(&game->history);
+    game->is_active = 0;
+    gm->active_games--;
+
+    // In a tournament the game counts as lost and the opponent stays
+    if (!end_tournament_game(game, is_player1 ? 0 : 2) && opponent > 0)
+    {
+        char *msg = "x Opponent disconnected. Game over.\n";
+        send_player(opponent, msg, strlen(msg), 0);
+        close_player(opponent);
+    }
+    int player = tournament_find(&tournament, socket);
+    if (player >= 0)
+    {
+        tournament_withdraw(&tournament, player);
+    }
+    close_player(socket);
+}
+
+// Route what a socket sent to the game, waiting room or tournament it is
+// in, a length of 0 or less means it was closed
+void handle_input(GameManager *gm, int socket, char *buffer, int length)
+{
+    ChessGame *game = find_game_by_socket(gm, socket);
+    if (game != NULL)
+    {
+        handle_player_input(gm, game, socket, buffer, length);
+    }
+    else if (waiting_room_contains(&waiting_room, socket))
+    {
+        handle_waiting_input(socket, length);
+    }
+    else if (tournament_find(&tournament, socket) >= 0)
+    {
+        handle_tournament_input(socket, length);
+    }
+}
+
+int read_input(int socket, char *buffer)
+{
+    memset(buffer, 0, BUFFER_SIZE);
+    return read(socket, buffer, BUFFER_SIZE);
+}
+
+// Let the engine play black against players who waited long enough
+void assign_bots(GameManager *gm)
+{
+    if (bot_after <= 0)
+    {
+        return;
+    }
+
+    time_t now = time(NULL);
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        ChessGame *game = &gm->games[i];
+        if (!game->is_active || game->player2_socket != -1 || now - game->waiting_since < bot_after)
+        {
+            continue;
+        }
+
+        game->player2_socket = BOT_SOCKET;
+        game->bot_player = 2;
+        char msg[100];
+        sprintf(msg, "Game #%d is starting against the server engine!\n", i);
+        send_player(game->player1_socket, msg, strlen(msg), 0);
+        request_bot_move(game);
+    }
+}
+
+// Play the moves the engine finished
+void handle_bot_results(GameManager *gm)
+{
+    SearchResult result;
+    while (engine_read_result(&result))
+    {
+        ChessGame *game = &gm->games[result.game_id];
+        if (!game->is_active || game->bot_ticket != result.ticket ||
+            game->bot_player != game->current_player)
+        {
+            continue;
+        }
+
+        if (!result.found)
+        {
+            printf("Engine has no move in game %d and resigns\n", result.game_id);
+            finish_game(game, 1);
+            continue;
+        }
+
+        char move[5];
+        format_move(&result.move, move);
+        printf("Engine plays %s in game %d: depth %d, score %d, %ld nodes in %.0f ms (%.0f nodes/s)\n",
+               move, result.game_id, result.depth, result.score, result.nodes, result.elapsed_ms,
+               result.elapsed_ms > 0 ? result.nodes * 1000.0 / result.elapsed_ms : 0.0);
+        play_move(game, BOT_SOCKET, move);
+    }
+    retry_bot_moves(gm);
+}
+
+// Start the engine when it is enabled or taken over games still use it
+void start_engine(GameManager *gm)
+{
+    int has_bot_games = 0;
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        if (gm->games[i].is_active && gm->games[i].bot_player)
+        {
+            has_bot_games = 1;
+        }
+    }
+    if (bot_after <= 0 && !has_bot_games)
+    {
+        return;
+    }
+
+    bot_results_fd = engine_start();
+    if (bot_results_fd < 0)
+    {
+        printf("Engine could not be started\n");
+        bot_after = 0;
+        return;
+    }
+    printf("Engine started: %d threads, %d ms per move, node limit %ld\n",
+           bot_threads, bot_limits.time_ms, bot_limits.max_nodes);
+
+    // Searches of the previous process were lost in a handoff
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        request_bot_move(&gm->games[i]);
+    }
+}
+
+// A new process asked to take over, on success this one stops serving
+void perform_handoff(GameManager *gm)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int connection = accept(handoff_fd, NULL, NULL);
+    if (connection < 0)
+    {
+        perror("handoff accept");
+        return;
+    }
+    if (tournament.player_count > 0)
+    {
+        printf("Handoff refused, tournament players can not be handed over\n");
+        close(connection);
+        return;
+    }
+
+    if (handoff_send(connection, server_fd, gm, &waiting_room) == 0)
+    {
+        printf("Handed off %d games in %.3f ms\n", gm->active_games, elapsed_ms(&start));
+        handed_off = 1;
+        server_running = 0;
+    }
+    else
+    {
+        printf("Handoff failed, still serving\n");
+    }
+    close(connection);
+}
+
+void run_select_loop(GameManager *gm)
+{
+    fd_set readfds;
+    struct timeval timeout;
+    char buffer[BUFFER_SIZE];
+
+    while (server_running)
+    {
+        FD_ZERO(&readfds);
+        FD_SET(server_fd, &readfds);
+
+        int max_sd = server_fd;
+
+        if (handoff_fd > 0)
+        {
+            FD_SET(handoff_fd, &readfds);
+            max_sd = handoff_fd > max_sd ? handoff_fd : max_sd;
+        }
+
+        if (bot_results_fd > 0)
+        {
+            FD_SET(bot_results_fd, &readfds);
+            max_sd = bot_results_fd > max_sd ? bot_results_fd : max_sd;
+        }
+
+        FD_SET(export_results_fd, &readfds);
+        max_sd = export_results_fd > max_sd ? export_results_fd : max_sd;
+
+        for (int i = 0; i < waiting_room.count; i++)
+        {
+            FD_SET(waiting_room.players[i].socket, &readfds);
+            max_sd = waiting_room.players[i].socket > max_sd ? waiting_room.players[i].socket : max_sd;
+        }
+
+        // Tournament players between games, the others are watched with their game
+        for (int i = 0; i < tournament.player_count; i++)
+        {
+            TournamentPlayer *player = &tournament.players[i];
+            if (player->socket >= 0 && player->game < 0)
+            {
+                FD_SET(player->socket, &readfds);
+                max_sd = player->socket > max_sd ? player->socket : max_sd;
+            }
+        }
+
+        // Add all active player sockets to the set
+        for (int i = 0; i < MAX_GAMES; i++)
+        {
+            if (gm->games[i].is_active)
+            {
+                if (gm->games[i].player1_socket > 0)
+                {
+                    FD_SET(gm->games[i].player1_socket, &readfds);
+                    max_sd = (gm->games[i].player1_socket > max_sd) ? gm->games[i].player1_socket : max_sd;
+                }
+                if (gm->games[i].player2_socket > 0)
+                {
+                    FD_SET(gm->games[i].player2_socket, &readfds);
+                    max_sd = (gm->games[i].player2_socket > max_sd) ? gm->games[i].player2_socket : max_sd;
+                }
+            }
+        }
+
+        // Keep passing through the loop while a tournament round is starting
+        timeout.tv_sec = tournament_starting() ? 0 : 1;
+        timeout.tv_usec = 0;
+
+        int activity = select(max_sd + 1, &readfds, NULL, NULL, &timeout);
+        if (activity < 0 && errno != EINTR)
+        {
+            perror("select error");
+            continue;
+        }
+
+        if (!server_running)
+        {
+            break;
+        }
+
+        if (handoff_fd > 0 && FD_ISSET(handoff_fd, &readfds))
+        {
+            perform_handoff(gm);
+            continue;
+        }
+
+        if (activity > 0 && bot_results_fd > 0 && FD_ISSET(bot_results_fd, &readfds))
+        {
+            handle_bot_results(gm);
+        }
+        if (activity > 0 && FD_ISSET(export_results_fd, &readfds))
+        {
+            handle_export_results(gm);
+        }
+        assign_bots(gm);
+
+        // Before anyone is seated, so a socket is never read twice in one pass
+        for (int i = 0; i < tournament.player_count; i++)
+        {
+            int socket = tournament.players[i].socket;
+            if (socket >= 0 && tournament.players[i].game < 0 && FD_ISSET(socket, &readfds))
+            {
+                FD_CLR(socket, &readfds);
+                handle_tournament_input(socket, read_input(socket, buffer));
+            }
+        }
+
+        // Handle new connections
+        if (FD_ISSET(server_fd, &readfds))
+        {
+            accept_player(gm);
+        }
+
+        // Handle player moves
+        for (int i = 0; i < MAX_GAMES; i++)
+        {
+            ChessGame *game = &gm->games[i];
+
+            // Check for player 1 activity
+            if (game->is_active && game->player1_socket > 0 &&
+                FD_ISSET(game->player1_socket, &readfds))
+            {
+                handle_player_input(gm, game, game->player1_socket, buffer, read_input(game->player1_socket, buffer));
+            }
+
+            // Check for player 2 activity
+            if (game->is_active && game->player2_socket > 0 &&
+                FD_ISSET(game->player2_socket, &readfds))
+            {
+                handle_player_input(gm, game, game->player2_socket, buffer, read_input(game->player2_socket, buffer));
+            }
+        }
+
+        // Players in the waiting room may leave
+        for (int i = waiting_room.count - 1; i >= 0; i--)
+        {
+            if (FD_ISSET(waiting_room.players[i].socket, &readfds))
+            {
+                int socket = waiting_room.players[i].socket;
+                handle_waiting_input(socket, read_input(socket, buffer));
+            }
+        }
+        admit_waiting_players(gm);
+        run_tournament(gm);
+    }
+}
+
+// Only sockets with pending data are reported, so an idle game costs nothing
+// per wakeup. Closed sockets leave the epoll set on their own.
+int run_epoll_loop(GameManager *gm)
+{
+    struct epoll_event event;
+    struct epoll_event events[MAX_EVENTS];
+
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    event.events = EPOLLIN;
+    event.data.fd = server_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event) < 0)
+    {
+        perror("epoll_ctl");
+        close(epoll_fd);
+        return -1;
+    }
+
+    if (handoff_fd > 0)
+    {
+        event.data.fd = handoff_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, handoff_fd, &event);
+    }
+
+    if (bot_results_fd > 0)
+    {
+        event.data.fd = bot_results_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bot_results_fd, &event);
+    }
+
+    event.data.fd = export_results_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, export_results_fd, &event);
+
+    // Players already present after a takeover
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        if (!gm->games[i].is_active)
+        {
+            continue;
+        }
+        if (gm->games[i].player1_socket > 0)
+        {
+            event.data.fd = gm->games[i].player1_socket;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, gm->games[i].player1_socket, &event);
+        }
+        if (gm->games[i].player2_socket > 0)
+        {
+            event.data.fd = gm->games[i].player2_socket;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, gm->games[i].player2_socket, &event);
+        }
+    }
+
+    while (server_running)
+    {
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, tournament_starting() ? 0 : 1000);
+        if (ready < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            continue;
+        }
+
+        if (!server_running)
+        {
+            break;
+        }
+
+        int has_new_connection = 0;
+        for (int i = 0; i < ready; i++)
+        {
+            int socket = events[i].data.fd;
+            if (socket == server_fd)
+            {
+                has_new_connection = 1;
+                continue;
+            }
+            if (socket == handoff_fd)
+            {
+                perform_handoff(gm);
+                break;
+            }
+            if (socket == bot_results_fd)
+            {
+                handle_bot_results(gm);
+                continue;
+            }
+            if (socket == export_results_fd)
+            {
+                handle_export_results(gm);
+                continue;
+            }
+
+            // The game may have ended earlier in this batch, a socket that
+            // was closed reads nothing and has no role left
+            char buffer[BUFFER_SIZE];
+            handle_input(gm, socket, buffer, read_input(socket, buffer));
+        }
+
+        admit_waiting_players(gm);
+        assign_bots(gm);
+        run_tournament(gm);
+
+        // Accept last, so a reused descriptor cannot pick up a stale event
+        if (has_new_connection && server_running)
+        {
+            int new_socket = accept_player(gm);
+            if (new_socket >= 0)
+            {
+                event.events = EPOLLIN;
+                event.data.fd = new_socket;
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_socket, &event) < 0)
+                {
+                    perror("epoll_ctl");
+                }
+            }
+        }
+    }
+
+    close(epoll_fd);
+    return 0;
+}
+
+static void ring_arm(RingRequest request, int fd)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+    if (sqe == NULL)
+    {
+        perror("io_uring");
+        return;
+    }
+    if (request == RING_ACCEPT)
+    {
+        uring_prep_accept_multishot(sqe, fd, RING_ACCEPT);
+    }
+    else if (request == RING_RECV)
+    {
+        uring_prep_recv_multishot(sqe, fd, ring_data(RING_RECV, fd));
+    }
+    else
+    {
+        uring_prep_poll_multishot(sqe, fd, request);
+    }
+    ring_armed++;
+}
+
+// Arm the listening socket, the pipes and every socket with a role
+static void ring_arm_all(GameManager *gm)
+{
+    ring_arm(RING_ACCEPT, server_fd);
+    if (handoff_fd > 0)
+    {
+        ring_arm(RING_HANDOFF, handoff_fd);
+    }
+    if (bot_results_fd > 0)
+    {
+        ring_arm(RING_BOT_RESULTS, bot_results_fd);
+    }
+    ring_arm(RING_EXPORT_RESULTS, export_results_fd);
+
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        if (!gm->games[i].is_active)
+        {
+            continue;
+        }
+        if (gm->games[i].player1_socket > 0)
+        {
+            ring_arm(RING_RECV, gm->games[i].player1_socket);
+        }
+        if (gm->games[i].player2_socket > 0)
+        {
+            ring_arm(RING_RECV, gm->games[i].player2_socket);
+        }
+    }
+    for (int i = 0; i < waiting_room.count; i++)
+    {
+        ring_arm(RING_RECV, waiting_room.players[i].socket);
+    }
+    for (int i = 0; i < tournament.player_count; i++)
+    {
+        if (tournament.players[i].socket >= 0 && tournament.players[i].game < 0)
+        {
+            ring_arm(RING_RECV, tournament.players[i].socket);
+        }
+    }
+}
+
+// Hand the output gathered during the pass to the ring: one send per
+// socket, and for a closed socket a chain that sends what is left, shuts it
+// down, which ends its recv, and closes it
+static void ring_flush_output(void)
+{
+    for (int i = 0; i < ring_dirty_count; i++)
+    {
+        int socket = ring_dirty[i];
+        RingSocket *output = &ring_sockets[socket];
+        output->dirty = 0;
+
+        // The completion of the send in flight lists the socket again
+        if (output->sending != NULL || (output->pending_length == 0 && !output->closing))
+        {
+            continue;
+        }
+        if (uring_reserve(&ring, 3) < 0)
+        {
+            perror("io_uring");
+            continue;
+        }
+
+        struct io_uring_sqe *sqe;
+        if (output->pending_length > 0)
+        {
+            output->sending = output->pending;
+            output->sending_length = output->pending_length;
+            output->sent = 0;
+            output->pending = NULL;
+            output->pending_length = 0;
+            output->pending_capacity = 0;
+            ring_sends++;
+            sqe = uring_get_sqe(&ring);
+            uring_prep_send(sqe, socket, output->sending, output->sending_length, ring_data(RING_SEND, socket));
+            if (!output->closing)
+            {
+                continue;
+            }
+            // Closed even when the send fails
+            sqe->flags |= IOSQE_IO_HARDLINK;
+            output->closed = 1;
+        }
+        else
+        {
+            free(output->pending);
+            memset(output, 0, sizeof(*output));
+        }
+        sqe = uring_get_sqe(&ring);
+        uring_prep_shutdown(sqe, socket, SHUT_RDWR, RING_CLOSE);
+        sqe->flags |= IOSQE_IO_HARDLINK;
+        uring_prep_close(uring_get_sqe(&ring), socket, RING_CLOSE);
+    }
+    ring_dirty_count = 0;
+}
 
-    // Set up signal handlers
-    // there are used to gracefully shutdown server using Ctrl+C
-    struct sigaction sa;
-    sa.sa_handler = handle_shutdown;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
+static void ring_sent(int socket, int result)
+{
+    RingSocket *output = &ring_sockets[socket];
+    if (result > 0 && output->sent + result < output->sending_length && !output->closed)
+    {
+        // Only an interrupted send stops early, the rest goes out again
+        struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+        if (sqe != NULL)
+        {
+            output->sent += result;
+            uring_prep_send(sqe, socket, output->sending + output->sent, output->sending_length - output->sent,
+                            ring_data(RING_SEND, socket));
+            return;
+        }
+    }
 
-    if (sigaction(SIGINT, &sa, NULL) == -1)
+    // A failed send means the player left, the recv reports it
+    free(output->sending);
+    output->sending = NULL;
+    ring_sends--;
+    if (output->closed)
     {
-        perror("sigaction");
-        exit(1);
+        int dirty = output->dirty;
+        free(output->pending);
+        memset(output, 0, sizeof(*output));
+        output->dirty = dirty;
     }
-    if (sigaction(SIGTERM, &sa, NULL) == -1)
+    else if (output->pending_length > 0 || output->closing)
     {
-        perror("sigaction");
-        exit(1);
+        ring_mark_dirty(socket);
     }
-    init_game_manager(&game_manager);
+}
+
+static void ring_accepted(GameManager *gm, struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        ring_armed--;
+        if (!ring_draining)
+        {
+            ring_arm(RING_ACCEPT, server_fd);
+        }
+    }
+    if (cqe->res < 0)
+    {
+        if (cqe->res != -ECANCELED)
+        {
+            errno = -cqe->res;
+            perror("accept");
+        }
+        return;
+    }
+
+    struct sockaddr_in address;
+    socklen_t addrlen = sizeof(address);
+    unsigned int ip = 0;
+    if (getpeername(cqe->res, (struct sockaddr *)&address, &addrlen) == 0)
+    {
+        ip = address.sin_addr.s_addr;
+    }
+
+    // While draining nothing new is armed, the socket is handed over as it is
+    int socket = admit_connection(gm, cqe->res, ip);
+    if (socket >= 0 && !ring_draining)
+    {
+        ring_arm(RING_RECV, socket);
+    }
+}
+
+static void ring_received(GameManager *gm, struct io_uring_cqe *cqe)
+{
+    int socket = ring_socket(cqe->user_data);
+    int current = (unsigned)(cqe->user_data >> 32) == socket_generations[socket];
+    int length = cqe->res;
+    char buffer[BUFFER_SIZE];
+
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        int id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        memcpy(buffer, uring_buffer(&ring, id), length);
+        uring_recycle_buffer(&ring, id);
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        ring_armed--;
+        // The socket is still open when the recv ended for lack of buffers
+        if (current && !ring_draining && (length > 0 || length == -ENOBUFS))
+        {
+            ring_arm(RING_RECV, socket);
+        }
+    }
+
+    // Completions of a socket closed since are dropped
+    if (current && length != -ENOBUFS && length != -ECANCELED)
+    {
+        handle_input(gm, socket, buffer, length);
+    }
+}
+
+static void ring_polled(GameManager *gm, struct io_uring_cqe *cqe)
+{
+    RingRequest request = cqe->user_data & 7;
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        ring_armed--;
+        if (!ring_draining)
+        {
+            ring_arm(request, request == RING_BOT_RESULTS      ? bot_results_fd
+                              : request == RING_EXPORT_RESULTS ? export_results_fd
+                                                               : handoff_fd);
+        }
+    }
+    if (cqe->res < 0)
+    {
+        return;
+    }
+
+    if (request == RING_BOT_RESULTS)
+    {
+        handle_bot_results(gm);
+    }
+    else if (request == RING_EXPORT_RESULTS)
+    {
+        handle_export_results(gm);
+    }
+    else
+    {
+        ring_handoff_requested = 1;
+    }
+}
+
+static void ring_handle_completions(GameManager *gm)
+{
+    struct io_uring_cqe cqe;
+    while (uring_next_cqe(&ring, &cqe))
+    {
+        switch (cqe.user_data & 7)
+        {
+        case RING_ACCEPT:
+            ring_accepted(gm, &cqe);
+            break;
+        case RING_RECV:
+            ring_received(gm, &cqe);
+            break;
+        case RING_SEND:
+            ring_sent(ring_socket(cqe.user_data), cqe.res);
+            break;
+        case RING_BOT_RESULTS:
+        case RING_EXPORT_RESULTS:
+        case RING_HANDOFF:
+            ring_polled(gm, &cqe);
+            break;
+        default:
+            break; // shutdowns, closes and cancels
+        }
+    }
+}
+
+// Run passes until nothing is armed and all output went out, or the time is
+// up. Input that arrives meanwhile is still handled.
+static void ring_drain(GameManager *gm, int keep_armed, double limit_ms)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((ring_sends > 0 || ring_dirty_count > 0 || (!keep_armed && ring_armed > 0)) &&
+           elapsed_ms(&start) < limit_ms)
+    {
+        ring_flush_output();
+        uring_submit(&ring, 10);
+        ring_handle_completions(gm);
+    }
+}
+
+// The sockets are handed over with nothing armed on them, so whatever the
+// players send next stays in the socket for the new process
+static void ring_handoff(GameManager *gm)
+{
+    // Output first, a cancel would take sends in flight with it
+    ring_drain(gm, 1, 1000);
+    ring_draining = 1;
+    struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+    if (sqe != NULL)
+    {
+        uring_prep_cancel_any(sqe, 0);
+    }
+    ring_drain(gm, 0, 1000);
+
+    perform_handoff(gm);
+    ring_draining = 0;
+    if (!handed_off)
+    {
+        ring_arm_all(gm);
+    }
+}
+
+// Completion based: accept and recv are armed once and keep completing,
+// received data lands in provided buffers, and the output of a pass is
+// submitted with the wait for the next one, so a busy pass costs one system
+// call however many players moved in it
+int run_uring_loop(GameManager *gm)
+{
+    if (uring_init(&ring, URING_ENTRIES, URING_BUFFERS, BUFFER_SIZE) < 0)
+    {
+        perror("io_uring");
+        return -1;
+    }
+    ring_sockets = calloc(socket_slots, sizeof(RingSocket));
+    ring_dirty = malloc(sizeof(int) * socket_slots);
+    if (ring_sockets == NULL || ring_dirty == NULL)
+    {
+        perror("io_uring");
+        free(ring_sockets);
+        free(ring_dirty);
+        uring_destroy(&ring);
+        return -1;
+    }
+    uring_active = 1;
+    ring_arm_all(gm);
+
+    while (server_running)
+    {
+        ring_flush_output();
+        if (uring_submit(&ring, tournament_starting() ? 0 : 1000) < 0)
+        {
+            perror("io_uring_enter");
+        }
+
+        if (!server_running)
+        {
+            break;
+        }
+
+        ring_handle_completions(gm);
+        admit_waiting_players(gm);
+        assign_bots(gm);
+        run_tournament(gm);
+
+        if (ring_handoff_requested)
+        {
+            ring_handoff_requested = 0;
+            ring_handoff(gm);
+        }
+    }
+
+    // The last messages go out before the ring is closed
+    ring_draining = 1;
+    ring_drain(gm, 1, 1000);
+    uring_active = 0;
+    printf("io_uring: %ld system calls\n", ring.enters);
+    uring_destroy(&ring);
+    for (int i = 0; i < socket_slots; i++)
+    {
+        free(ring_sockets[i].pending);
+        free(ring_sockets[i].sending);
+    }
+    free(ring_sockets);
+    free(ring_dirty);
+    return 0;
+}
+
+// Create, bind and listen on the game port
+void open_server_socket()
+{
+    struct sockaddr_in address;
+    int opt = 1;
 
     // Create socket
     if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0)
@@ -465,169 +2392,154 @@ int main(int argc, char **argv)
         cleanup_server();
         exit(EXIT_FAILURE);
     }
+}
 
-    printf("Chess server started on port %d. Waiting for players...\n", port);
+int main(int argc, char **argv)
+{
+    setbuf(stdout, NULL); // Add this line at the start of main
+    parse_args(argc, argv);
+    load_fen(&start_position, start_fen);
+    write_fen(&start_position, start_position.start_fen, FEN_MAX_LENGTH);
 
-    struct timeval timeout;
+    static GameManager game_manager;
 
-    while (server_running)
-    {
-        FD_ZERO(&readfds);
-        FD_SET(server_fd, &readfds);
+    global_game_manager = &game_manager;
 
-        int max_sd = server_fd;
+    // Set up signal handlers
+    // there are used to gracefully shutdown server using Ctrl+C
+    struct sigaction sa;
+    sa.sa_handler = handle_shutdown;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
 
-        // Add all active player sockets to the set
-        for (int i = 0; i < MAX_GAMES; i++)
+    if (sigaction(SIGINT, &sa, NULL) == -1)
+    {
+        perror("sigaction");
+        exit(1);
+    }
+    if (sigaction(SIGTERM, &sa, NULL) == -1)
+    {
+        perror("sigaction");
+        exit(1);
+    }
+
+    // A client that hung up must not take the server down with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    init_game_manager(&game_manager);
+    init_socket_tables();
+    token_bucket_init(&accept_bucket, accept_rate, accept_burst);
+    if (waiting_room_init(&waiting_room, waiting_room_size) < 0)
+    {
+        perror("waiting room");
+        exit(1);
+    }
+    if (book_path != NULL)
+    {
+        if (book_open(&book, book_path) < 0)
         {
-            if (game_manager.games[i].is_active)
-            {
-                if (game_manager.games[i].player1_socket > 0)
-                {
-                    FD_SET(game_manager.games[i].player1_socket, &readfds);
-                    max_sd = (game_manager.games[i].player1_socket > max_sd) ? game_manager.games[i].player1_socket : max_sd;
-                }
-                if (game_manager.games[i].player2_socket > 0)
-                {
-                    FD_SET(game_manager.games[i].player2_socket, &readfds);
-                    max_sd = (game_manager.games[i].player2_socket > max_sd) ? game_manager.games[i].player2_socket : max_sd;
-                }
-            }
+            exit(1);
         }
-
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-
-        int activity = select(max_sd + 1, &readfds, NULL, NULL, &timeout);
-        if (activity < 0 && errno != EINTR)
+        srand(time(NULL));
+        printf("Opening book %s: %lu entries\n", book_path, (unsigned long)book.count);
+    }
+    if (event_queue_size > 0)
+    {
+        if (spsc_init(&game_events, event_queue_size) < 0 || metrics_start(&game_events) < 0)
         {
-            perror("select error");
-            continue;
+            printf("Could not start the event queue\n");
+            exit(1);
         }
+        events_enabled = 1;
+    }
+    if (archive_path != NULL && (archive_fd = archive_open(archive_path)) < 0)
+    {
+        exit(1);
+    }
+    if (tablebase_path != NULL)
+    {
+        tablebase_count = tablebase_open(tablebase_path);
+        printf("Tablebases in %s: %d tables\n", tablebase_path, tablebase_count);
+    }
 
-        if (!server_running)
+    if (tournament_rounds > 0)
+    {
+        if (tournament_players < 2 || tournament_players / 2 > MAX_GAMES)
         {
-            break;
+            printf("A tournament needs 2 to %d players, the server is built for %d games\n",
+                   MAX_GAMES * 2, MAX_GAMES);
+            exit(1);
         }
-
-        // Handle new connections
-        if (FD_ISSET(server_fd, &readfds))
+        if (tournament_init(&tournament, tournament_rounds, tournament_players) < 0)
         {
-            if ((new_socket = accept(server_fd, (struct sockaddr *)&address,
-                                     (socklen_t *)&addrlen)) < 0)
-            {
-                perror("accept");
-                continue;
-            }
-
-            // Find or create a game for the new player
-            int game_idx = -1;
-            for (int i = 0; i < MAX_GAMES; i++)
-            {
-                if (game_manager.games[i].is_active &&
-                    game_manager.games[i].player2_socket == -1)
-                {
-                    game_idx = i;
-                    break;
-                }
-            }
+            perror("tournament");
+            exit(1);
+        }
+        printf("Tournament: %d rounds, starts with %d players\n", tournament_rounds, tournament_players);
+    }
 
-            if (game_idx == -1)
-            {
-                game_idx = find_available_game(&game_manager);
-                if (game_idx != -1)
-                {
-                    // Initialize new game
-                    game_manager.games[game_idx].is_active = 1;
-                    game_manager.games[game_idx].player1_socket = new_socket;
-                    game_manager.games[game_idx].player2_socket = -1;
-                    init_board(&game_manager.games[game_idx]);
-                    game_manager.active_games++;
-
-                    char msg[100];
-                    sprintf(msg, "Welcome! You are Player White in Game #%d. Waiting for opponent...\n",
-                            game_idx);
-                    send(new_socket, msg, strlen(msg), 0);
-                    send_board(new_socket, &game_manager.games[game_idx]);
-                }
-            }
-            else
+    if (takeover_path != NULL)
+    {
+        // Continue the games of the running server instead of starting fresh
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (handoff_receive(takeover_path, &server_fd, &game_manager, &waiting_room) < 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < MAX_GAMES; i++)
+        {
+            index_socket(game_manager.games[i].player1_socket, i);
+            index_socket(game_manager.games[i].player2_socket, i);
+            if (game_manager.games[i].is_active)
             {
-                // Add second player to existing game
-                game_manager.games[game_idx].player2_socket = new_socket;
-                char msg[100];
-                sprintf(msg, "Welcome! You are Player Black in Game #%d\n", game_idx);
-                send(new_socket, msg, strlen(msg), 0);
-                send_board(new_socket, &game_manager.games[game_idx]);
-
-                // Notify both players that game is starting
-                sprintf(msg, "Game #%d is starting!\n", game_idx);
-                send(game_manager.games[game_idx].player1_socket, msg, strlen(msg), 0);
-                send(game_manager.games[game_idx].player2_socket, msg, strlen(msg), 0);
+                count_connection(game_manager.games[i].player1_socket, game_manager.games[i].player1_ip);
+                count_connection(game_manager.games[i].player2_socket, game_manager.games[i].player2_ip);
             }
         }
-
-        // Handle player moves
-        for (int i = 0; i < MAX_GAMES; i++)
+        for (int i = 0; i < waiting_room.count; i++)
         {
-            if (!game_manager.games[i].is_active)
-                continue;
+            count_connection(waiting_room.players[i].socket, waiting_room.players[i].ip);
+        }
+        printf("Took over %d games in %.3f ms\n", game_manager.active_games, elapsed_ms(&start));
+    }
+    else
+    {
+        open_server_socket();
+    }
+
+    if (handoff_path != NULL && (handoff_fd = handoff_listen(handoff_path)) < 0)
+    {
+        cleanup_server();
+        exit(EXIT_FAILURE);
+    }
 
-            ChessGame *game = &game_manager.games[i];
+    printf("Chess server started on port %d. Waiting for players...\n", port);
+    printf("Attack detection backend: %s\n", attack_backend_name(get_attack_backend()));
 
-            // Check for player 1 activity
-            if (game->player1_socket > 0 &&
-                FD_ISSET(game->player1_socket, &readfds))
-            {
-                memset(buffer, 0, BUFFER_SIZE);
-                int valread = read(game->player1_socket, buffer, BUFFER_SIZE);
-                if (valread <= 0)
-                {
-                    printf("Player 1 disconnected from game %d\n", i);
-                    close(game->player1_socket);
-                    if (game->player2_socket > 0)
-                    {
-                        send(game->player2_socket,
-                             "x Opponent disconnected. Game over.\n", 32, 0);
-                        close(game->player2_socket);
-                    }
-                    game->is_active = 0;
-                    game_manager.active_games--;
-                }
-                else
-                {
-                    buffer[valread - 1] = '\0';
-                    handle_move(game->player1_socket, &game_manager, buffer);
-                }
-            }
+    printf("Event backend: %s\n", event_backend_names[event_backend]);
+    if (pool_start(bot_threads) < 0 || (export_results_fd = export_start()) < 0)
+    {
+        printf("Worker threads could not be started\n");
+        cleanup_server();
+        exit(EXIT_FAILURE);
+    }
+    start_engine(&game_manager);
 
-            // Check for player 2 activity
-            if (game->player2_socket > 0 &&
-                FD_ISSET(game->player2_socket, &readfds))
-            {
-                memset(buffer, 0, BUFFER_SIZE);
-                int valread = read(game->player2_socket, buffer, BUFFER_SIZE);
-                if (valread <= 0)
-                {
-                    printf("Player 2 disconnected from game %d\n", i);
-                    close(game->player2_socket);
-                    if (game->player1_socket > 0)
-                    {
-                        send(game->player1_socket,
-                             "x Opponent disconnected. Game over.\n", 32, 0);
-                        close(game->player1_socket);
-                    }
-                    game->is_active = 0;
-                    game_manager.active_games--;
-                }
-                else
-                {
-                    buffer[valread - 1] = '\0';
-                    handle_move(game->player2_socket, &game_manager, buffer);
-                }
-            }
-        }
+    if (event_backend == EVENTS_URING && run_uring_loop(&game_manager) < 0)
+    {
+        printf("Falling back to epoll\n");
+        event_backend = EVENTS_EPOLL;
+    }
+    if (event_backend == EVENTS_EPOLL && run_epoll_loop(&game_manager) < 0)
+    {
+        printf("Falling back to select\n");
+        event_backend = EVENTS_SELECT;
+    }
+    if (event_backend == EVENTS_SELECT)
+    {
+        run_select_loop(&game_manager);
     }
+
     cleanup_server();
     return 0;
 }
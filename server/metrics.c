@@ -0,0 +1,76 @@
+#include "metrics.h"
+#include <pthread.h>
+
+#define METRICS_BATCH 64
+
+static SpscQueue *events;
+static EventMetrics metrics;
+static pthread_t thread;
+static atomic_int stopping;
+
+static void consume(GameEvent *batch, int count)
+{
+    uint64_t now = event_clock_ns();
+    metrics.batches++;
+    for (int i = 0; i < count; i++)
+    {
+        double latency_us = (now - batch[i].time_ns) / 1000.0;
+        metrics.total_latency_us += latency_us;
+        if (latency_us > metrics.max_latency_us)
+        {
+            metrics.max_latency_us = latency_us;
+        }
+
+        if (batch[i].type == EVENT_MOVE)
+        {
+            metrics.moves++;
+            metrics.captures += batch[i].captured != '.';
+        }
+        else if (batch[i].type == EVENT_GAME_END)
+        {
+            metrics.games_ended++;
+        }
+    }
+}
+
+static void *metrics_main(void *arg)
+{
+    (void)arg;
+    GameEvent batch[METRICS_BATCH];
+    for (;;)
+    {
+        int count = spsc_pop_batch(events, batch, METRICS_BATCH);
+        if (count > 0)
+        {
+            consume(batch, count);
+            continue;
+        }
+        if (atomic_load(&stopping))
+        {
+            return NULL;
+        }
+        spsc_wait(events, 1000);
+    }
+}
+
+int metrics_start(SpscQueue *queue)
+{
+    events = queue;
+    atomic_store(&stopping, 0);
+    memset(&metrics, 0, sizeof(metrics));
+    if (pthread_create(&thread, NULL, metrics_main, NULL) != 0)
+    {
+        perror("metrics thread");
+        return -1;
+    }
+    return 0;
+}
+
+// Consume what is left, stop the thread and hand back the counters
+void metrics_stop(EventMetrics *result)
+{
+    atomic_store(&stopping, 1);
+    spsc_wake(events);
+    pthread_join(thread, NULL);
+    *result = metrics;
+}
@@ -0,0 +1,21 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "queue.h"
+
+// Service thread that consumes the game events and keeps counters, the
+// first consumer of the event ring
+
+typedef struct
+{
+    long moves;
+    long captures;
+    long games_ended;
+    long batches;
+    double total_latency_us; // from publishing to consuming
+    double max_latency_us;
+} EventMetrics;
+
+int metrics_start(SpscQueue *queue);
+void metrics_stop(EventMetrics *result);
+#endif // METRICS_H
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "fen.h"
+#include "book.h"
+#include "history.h"
+
+// Build an opening book from played games, one game per line as moves in
+// the server's notation, for example
+//   e2e4 e7e5 g1f3 b8c6 f1b5
+// Games start from the standard position unless -f is given. A game stops
+// counting at its first move the rules reject.
+
+#define LINE_SIZE 4096
+
+int max_plies = 16;
+const char *start_fen = START_FEN;
+
+BookEntry *entries = NULL;
+uint64_t entry_count = 0;
+uint64_t entry_capacity = 0;
+
+int compare_entries(const void *a, const void *b)
+{
+    const BookEntry *x = a;
+    const BookEntry *y = b;
+    if (x->key != y->key)
+    {
+        return x->key < y->key ? -1 : 1;
+    }
+    if (x->move != y->move)
+    {
+        return x->move < y->move ? -1 : 1;
+    }
+    return 0;
+}
+
+void add_entry(uint64_t key, PackedMove move)
+{
+    if (entry_count == entry_capacity)
+    {
+        entry_capacity = entry_capacity ? entry_capacity * 2 : 4096;
+        entries = realloc(entries, sizeof(BookEntry) * entry_capacity);
+        if (entries == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    BookEntry *entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->key = key;
+    entry->move = move;
+    entry->weight = 1;
+}
+
+// Returns the number of moves taken into the book
+int add_game(char *line)
+{
+    ChessGame game;
+    int plies = 0;
+
+    memset(&game, 0, sizeof(game));
+    load_fen(&game, start_fen);
+
+    for (char *word = strtok(line, " \t\r\n"); word != NULL && plies < max_plies; word = strtok(NULL, " \t\r\n"))
+    {
+        int isPlayerWhite = game.current_player == 1;
+        if (strlen(word) != 4)
+        {
+            break;
+        }
+        Move move = convert(word);
+        if (validate_move(&game, &move, isPlayerWhite) != MOVE_VALID)
+        {
+            break;
+        }
+
+        add_entry(position_hash(&game), pack_move(&move, 0, 0));
+        char piece = game.board[move.from_row][move.from_col];
+        move_king(&game, &move);
+        char piece_taken = apply_move(&move, game.board);
+        update_position_state(&game, &move, piece, piece_taken);
+        game.current_player = isPlayerWhite ? 2 : 1;
+        plies++;
+    }
+    return plies;
+}
+
+// Sort by key and fold repeated moves into one weighted entry
+void merge_entries(void)
+{
+    uint64_t merged = 0;
+    qsort(entries, entry_count, sizeof(BookEntry), compare_entries);
+    for (uint64_t i = 0; i < entry_count; i++)
+    {
+        if (merged > 0 && compare_entries(&entries[merged - 1], &entries[i]) == 0)
+        {
+            if (entries[merged - 1].weight < UINT16_MAX)
+            {
+                entries[merged - 1].weight++;
+            }
+            continue;
+        }
+        entries[merged++] = entries[i];
+    }
+    entry_count = merged;
+}
+
+void usage(char *name)
+{
+    printf("usage: %s [-d PLIES] [-f FEN] BOOK [GAMES]\n", name);
+    printf("OPTIONS\n");
+    printf("  -d --depth PLIES  moves of every game taken into the book\n");
+    printf("  -f --fen   FEN    starting position of the games\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *book_path = NULL;
+    char *games_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--depth") == 0) && i + 1 < argc)
+        {
+            max_plies = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--fen") == 0) && i + 1 < argc)
+        {
+            ChessGame game;
+            start_fen = argv[++i];
+            if (load_fen(&game, start_fen) != 0)
+            {
+                printf("Invalid FEN: %s\n", start_fen);
+                exit(1);
+            }
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+        }
+        else if (book_path == NULL)
+        {
+            book_path = argv[i];
+        }
+        else
+        {
+            games_path = argv[i];
+        }
+    }
+
+    if (book_path == NULL || max_plies < 1)
+    {
+        usage(argv[0]);
+    }
+
+    FILE *input = games_path ? fopen(games_path, "r") : stdin;
+    if (input == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+
+    char line[LINE_SIZE];
+    long games = 0;
+    long moves = 0;
+    while (fgets(line, LINE_SIZE, input) != NULL)
+    {
+        int plies = add_game(line);
+        games += plies > 0;
+        moves += plies;
+    }
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    merge_entries();
+
+    FILE *output = fopen(book_path, "wb");
+    if (output == NULL)
+    {
+        perror("fopen");
+        exit(1);
+    }
+    BookHeader header;
+    header.magic = BOOK_MAGIC;
+    header.version = BOOK_VERSION;
+    header.count = entry_count;
+    if (fwrite(&header, sizeof(header), 1, output) != 1 ||
+        fwrite(entries, sizeof(BookEntry), entry_count, output) != entry_count ||
+        fclose(output) != 0)
+    {
+        perror("write");
+        exit(1);
+    }
+
+    printf("%ld games, %ld moves, %lu book entries\n", games, moves, (unsigned long)entry_count);
+    free(entries);
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "engine.h"
+#include "tablebase.h"
+
+// Solve king and piece against king endgames under the server's rules and
+// write one table per piece, e.g. "mktb -o tables Q R" writes tables/KQK.tb
+// and tables/KRK.tb.
+//
+// Every position's moves are generated once, then the values are filled in
+// ply by ply: a position is won in n plies when a move reaches a position
+// lost in n - 1, and lost in n when every move reaches a position won in at
+// most n - 1 with one of them taking exactly n - 1. Whatever is left is a draw.
+
+#define KING_TAKEN -1 // the move captures the opposing king
+#define TO_DRAW -2    // the move captures the extra piece, kings alone draw
+#define UNKNOWN 254
+
+int *first_successor;
+int *successors;
+long successor_count = 0;
+long successor_capacity = 0;
+
+void add_successor(int index)
+{
+    if (successor_count == successor_capacity)
+    {
+        successor_capacity = successor_capacity ? successor_capacity * 2 : 1 << 20;
+        successors = realloc(successors, sizeof(int) * successor_capacity);
+        if (successors == NULL)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    successors[successor_count++] = index;
+}
+
+// Generate the moves of every position, mates and stalemates get their value
+void generate_graph(char piece, unsigned char *values)
+{
+    Move moves[MAX_MOVES];
+    for (long index = 0; index < TABLEBASE_POSITIONS; index++)
+    {
+        ChessGame game;
+        first_successor[index] = successor_count;
+        values[index] = TB_INVALID;
+        if (!tablebase_position(index, piece, &game))
+        {
+            continue;
+        }
+
+        int isPlayerWhite = game.current_player == 1;
+        int count = generate_moves(&game, isPlayerWhite, moves);
+        if (count == 0)
+        {
+            values[index] = is_king_checked(&game, isPlayerWhite) ? TB_LOSS : TB_DRAW;
+            continue;
+        }
+        values[index] = UNKNOWN;
+
+        for (int i = 0; i < count; i++)
+        {
+            char target = game.board[moves[i].to_row][moves[i].to_col];
+            if (tolower(target) == 'k')
+            {
+                add_successor(KING_TAKEN);
+                continue;
+            }
+            if (target != '.')
+            {
+                add_successor(TO_DRAW);
+                continue;
+            }
+
+            ChessGame next = game;
+            char extra;
+            move_king(&next, &moves[i]);
+            apply_move(&moves[i], next.board);
+            next.current_player = isPlayerWhite ? 2 : 1;
+            add_successor(tablebase_index(&next, &extra));
+        }
+    }
+    first_successor[TABLEBASE_POSITIONS] = successor_count;
+}
+
+// Value of a successor from the point of view of its side to move
+int successor_value(int successor, unsigned char *values)
+{
+    if (successor == KING_TAKEN)
+    {
+        return TB_LOSS;
+    }
+    if (successor == TO_DRAW)
+    {
+        return TB_DRAW;
+    }
+    return values[successor];
+}
+
+void solve(unsigned char *values)
+{
+    for (int plies = 1; plies <= TB_MAX_PLIES; plies++)
+    {
+        long changed = 0;
+        for (long index = 0; index < TABLEBASE_POSITIONS; index++)
+        {
+            if (values[index] != UNKNOWN)
+            {
+                continue;
+            }
+
+            int wins = 0;
+            int all_lost = 1;
+            int longest = 0;
+            for (int i = first_successor[index]; i < first_successor[index + 1]; i++)
+            {
+                int value = successor_value(successors[i], values);
+                if (value == TB_LOSS + plies - 1)
+                {
+                    wins = 1;
+                    break;
+                }
+                if (value == UNKNOWN || value == TB_DRAW || value >= TB_LOSS || value > plies - 1)
+                {
+                    all_lost = 0;
+                }
+                else if (value > longest)
+                {
+                    longest = value;
+                }
+            }
+
+            if (wins)
+            {
+                values[index] = plies;
+                changed++;
+            }
+            else if (all_lost && longest == plies - 1)
+            {
+                values[index] = TB_LOSS + plies;
+                changed++;
+            }
+        }
+        if (changed == 0)
+        {
+            break;
+        }
+    }
+
+    for (long index = 0; index < TABLEBASE_POSITIONS; index++)
+    {
+        if (values[index] == UNKNOWN)
+        {
+            values[index] = TB_DRAW;
+        }
+    }
+}
+
+int write_table(const char *directory, char piece, unsigned char *values)
+{
+    char path[512];
+    TablebaseHeader header;
+    snprintf(path, sizeof(path), "%s/K%cK.tb", directory, piece);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = TABLEBASE_MAGIC;
+    header.version = TABLEBASE_VERSION;
+    header.piece = piece;
+
+    FILE *output = fopen(path, "wb");
+    if (output == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    if (fwrite(&header, sizeof(header), 1, output) != 1 ||
+        fwrite(values, 1, TABLEBASE_POSITIONS, output) != TABLEBASE_POSITIONS ||
+        fclose(output) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+void usage(char *name)
+{
+    printf("usage: %s [-o DIRECTORY] PIECE...\n", name);
+    printf("  PIECE is one of %s, the table holds king and PIECE against king\n", TABLEBASE_PIECES);
+    printf("  -o --output DIRECTORY  where the tables are written\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *directory = ".";
+    char pieces[8];
+    int piece_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else if (strlen(argv[i]) == 1 && strchr(TABLEBASE_PIECES, toupper(argv[i][0])) != NULL &&
+                 piece_count < 8)
+        {
+            pieces[piece_count++] = toupper(argv[i][0]);
+        }
+        else
+        {
+            usage(argv[0]);
+        }
+    }
+    if (piece_count == 0)
+    {
+        usage(argv[0]);
+    }
+
+    unsigned char *values = malloc(TABLEBASE_POSITIONS);
+    first_successor = malloc(sizeof(int) * (TABLEBASE_POSITIONS + 1));
+    if (values == NULL || first_successor == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int p = 0; p < piece_count; p++)
+    {
+        successor_count = 0;
+        generate_graph(pieces[p], values);
+        solve(values);
+
+        long wins = 0, draws = 0, longest = 0;
+        for (long index = 0; index < TABLEBASE_POSITIONS; index++)
+        {
+            if (values[index] == TB_DRAW)
+            {
+                draws++;
+            }
+            else if (values[index] < TB_LOSS)
+            {
+                wins++;
+                longest = values[index] > longest ? values[index] : longest;
+            }
+        }
+        printf("K%cK: %ld won, %ld drawn, %ld moves, longest mate %ld plies\n",
+               pieces[p], wins, draws, successor_count, longest);
+
+        if (write_table(directory, pieces[p], values) < 0)
+        {
+            exit(1);
+        }
+    }
+
+    free(values);
+    free(first_successor);
+    free(successors);
+    return 0;
+}
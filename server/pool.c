@@ -0,0 +1,191 @@
+#include "pool.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    TaskFunction function;
+    void *arg;
+} Task;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    Task tasks[POOL_QUEUE_SIZE];
+    int top;    // oldest task, stolen by other workers
+    int bottom; // one past the newest task, taken by the owner
+} TaskDeque;
+
+static TaskDeque deques[POOL_MAX_THREADS];
+static pthread_t workers[POOL_MAX_THREADS];
+static int worker_count = 0;
+static int deque_count = 0; // fixed before the workers start, they steal from all
+static int next_deque = 0;
+
+// Idle workers sleep here, every submitted task posts it once
+static sem_t pool_wakeup;
+static atomic_int pending_tasks = 0; // pushed and not yet taken
+static atomic_int stopping = 0;
+
+static int take_newest(TaskDeque *deque, Task *task)
+{
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top)
+    {
+        deque->bottom--;
+        *task = deque->tasks[deque->bottom % POOL_QUEUE_SIZE];
+        atomic_fetch_sub(&pending_tasks, 1);
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static int steal_oldest(TaskDeque *deque, Task *task)
+{
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top)
+    {
+        *task = deque->tasks[deque->top % POOL_QUEUE_SIZE];
+        deque->top++;
+        atomic_fetch_sub(&pending_tasks, 1);
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static int find_task(int self, Task *task)
+{
+    if (take_newest(&deques[self], task))
+    {
+        return 1;
+    }
+    for (int i = 1; i < deque_count; i++)
+    {
+        if (steal_oldest(&deques[(self + i) % deque_count], task))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg)
+{
+    int self = (int)(long)arg;
+    Task task;
+
+    for (;;)
+    {
+        if (find_task(self, &task))
+        {
+            task.function(task.arg);
+        }
+        else if (atomic_load(&stopping))
+        {
+            // A task submitted just before the stop can land behind the
+            // scan, so a stopping worker leaves once every task was taken
+            if (atomic_load(&pending_tasks) == 0)
+            {
+                return NULL;
+            }
+        }
+        else
+        {
+            // A task pushed after the scan has already posted, so the
+            // wait returns at once instead of missing it
+            sem_wait(&pool_wakeup);
+        }
+    }
+}
+
+// Returns -1 when no worker could be started
+int pool_start(int threads)
+{
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if (threads > POOL_MAX_THREADS)
+    {
+        threads = POOL_MAX_THREADS;
+    }
+
+    if (sem_init(&pool_wakeup, 0, 0) != 0)
+    {
+        return -1;
+    }
+    atomic_store(&stopping, 0);
+    deque_count = threads;
+    next_deque = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&deques[i].lock, NULL);
+        deques[i].top = 0;
+        deques[i].bottom = 0;
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&workers[i], NULL, worker_main, (void *)(long)i) != 0)
+        {
+            break;
+        }
+        worker_count++;
+    }
+    if (worker_count == 0)
+    {
+        sem_destroy(&pool_wakeup);
+        return -1;
+    }
+    return 0;
+}
+
+// Only called from the thread owning the pool, returns -1 when the deque is full
+int pool_submit(TaskFunction function, void *arg)
+{
+    if (worker_count == 0)
+    {
+        return -1;
+    }
+
+    TaskDeque *deque = &deques[next_deque];
+    next_deque = (next_deque + 1) % deque_count;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom - deque->top >= POOL_QUEUE_SIZE)
+    {
+        pthread_mutex_unlock(&deque->lock);
+        return -1;
+    }
+    deque->tasks[deque->bottom % POOL_QUEUE_SIZE].function = function;
+    deque->tasks[deque->bottom % POOL_QUEUE_SIZE].arg = arg;
+    deque->bottom++;
+    atomic_fetch_add(&pending_tasks, 1);
+    pthread_mutex_unlock(&deque->lock);
+
+    sem_post(&pool_wakeup);
+    return 0;
+}
+
+// Finish the queued tasks and join the workers
+void pool_stop(void)
+{
+    atomic_store(&stopping, 1);
+    for (int i = 0; i < worker_count; i++)
+    {
+        sem_post(&pool_wakeup);
+    }
+
+    for (int i = 0; i < worker_count; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    worker_count = 0;
+    sem_destroy(&pool_wakeup);
+}
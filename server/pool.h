@@ -0,0 +1,16 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Worker threads with one task deque each. Workers take their newest task
+// first and steal the oldest task of another worker when they run dry.
+// Only the deque locks are shared, idle workers sleep on a semaphore.
+
+#define POOL_MAX_THREADS 32
+#define POOL_QUEUE_SIZE 1024
+
+typedef void (*TaskFunction)(void *arg);
+
+int pool_start(int threads);
+int pool_submit(TaskFunction function, void *arg);
+void pool_stop(void);
+#endif // POOL_H
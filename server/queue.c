@@ -0,0 +1,250 @@
+#include "queue.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+
+uint64_t event_clock_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Capacity is rounded up to a power of two so slots are found with a mask
+static size_t round_capacity(size_t capacity)
+{
+    size_t rounded = 2;
+    while (rounded < capacity)
+    {
+        rounded *= 2;
+    }
+    return rounded;
+}
+
+static void signal_wake_fd(int wake_fd)
+{
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        perror("eventfd write");
+    }
+}
+
+// Producer side of the wakeup. The fence pairs with the one in wait_on, so
+// either the producer sees the consumer asleep or the consumer sees the event.
+static void wake_consumer(_Atomic int *sleeping, int wake_fd)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(sleeping, memory_order_relaxed) &&
+        atomic_exchange(sleeping, 0))
+    {
+        signal_wake_fd(wake_fd);
+    }
+}
+
+// Consumer side of the wakeup
+static int wait_on(_Atomic int *sleeping, int wake_fd, int (*is_empty)(void *), void *queue, int timeout_ms)
+{
+    atomic_store(sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!is_empty(queue))
+    {
+        atomic_store(sleeping, 0);
+        return 1;
+    }
+
+    struct pollfd fd = {wake_fd, POLLIN, 0};
+    int ready = poll(&fd, 1, timeout_ms);
+    atomic_store(sleeping, 0);
+    if (ready > 0)
+    {
+        uint64_t count;
+        if (read(wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        {
+            perror("eventfd read");
+        }
+        return 1;
+    }
+    return 0;
+}
+
+int spsc_init(SpscQueue *queue, size_t capacity)
+{
+    memset(queue, 0, sizeof(*queue));
+    capacity = round_capacity(capacity);
+    queue->slots = calloc(capacity, sizeof(GameEvent));
+    queue->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->slots == NULL || queue->wake_fd < 0)
+    {
+        if (queue->wake_fd >= 0)
+        {
+            close(queue->wake_fd);
+        }
+        free(queue->slots);
+        return -1;
+    }
+    queue->mask = capacity - 1;
+    return 0;
+}
+
+// Returns -1 when the ring is full
+int spsc_push(SpscQueue *queue, GameEvent *event)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - queue->cached_head > queue->mask)
+    {
+        queue->cached_head = atomic_load_explicit(&queue->head, memory_order_acquire);
+        if (tail - queue->cached_head > queue->mask)
+        {
+            return -1;
+        }
+    }
+    queue->slots[tail & queue->mask] = *event;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    wake_consumer(&queue->sleeping, queue->wake_fd);
+    return 0;
+}
+
+// Take up to max events, returns how many were taken
+int spsc_pop_batch(SpscQueue *queue, GameEvent *events, int max)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (queue->cached_tail == head)
+    {
+        queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    }
+    size_t available = queue->cached_tail - head;
+    int count = available < (size_t)max ? (int)available : max;
+    for (int i = 0; i < count; i++)
+    {
+        events[i] = queue->slots[(head + i) & queue->mask];
+    }
+    atomic_store_explicit(&queue->head, head + count, memory_order_release);
+    return count;
+}
+
+static int spsc_is_empty(void *arg)
+{
+    SpscQueue *queue = arg;
+    return atomic_load(&queue->tail) == atomic_load_explicit(&queue->head, memory_order_relaxed);
+}
+
+// Sleep until an event arrives, spsc_wake is called or the timeout passes.
+// Returns 1 when woken and 0 on timeout.
+int spsc_wait(SpscQueue *queue, int timeout_ms)
+{
+    return wait_on(&queue->sleeping, queue->wake_fd, spsc_is_empty, queue, timeout_ms);
+}
+
+// Wake the consumer even without a new event, e.g. to make it stop. A
+// consumer that is not asleep returns from its next wait right away.
+void spsc_wake(SpscQueue *queue)
+{
+    signal_wake_fd(queue->wake_fd);
+}
+
+void spsc_destroy(SpscQueue *queue)
+{
+    close(queue->wake_fd);
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+int mpsc_init(MpscQueue *queue, size_t capacity)
+{
+    memset(queue, 0, sizeof(*queue));
+    capacity = round_capacity(capacity);
+    queue->slots = calloc(capacity, sizeof(MpscSlot));
+    queue->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->slots == NULL || queue->wake_fd < 0)
+    {
+        if (queue->wake_fd >= 0)
+        {
+            close(queue->wake_fd);
+        }
+        free(queue->slots);
+        return -1;
+    }
+    queue->mask = capacity - 1;
+    for (size_t i = 0; i < capacity; i++)
+    {
+        atomic_init(&queue->slots[i].sequence, i);
+    }
+    return 0;
+}
+
+// Producers claim a slot by moving the tail, the slot's sequence number
+// says whether it is free (equal to the position) or still being read.
+// Returns -1 when the ring is full.
+int mpsc_push(MpscQueue *queue, GameEvent *event)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    MpscSlot *slot;
+    for (;;)
+    {
+        slot = &queue->slots[tail & queue->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)tail;
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &tail, tail + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            return -1;
+        }
+        else
+        {
+            tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    slot->event = *event;
+    atomic_store_explicit(&slot->sequence, tail + 1, memory_order_release);
+    wake_consumer(&queue->sleeping, queue->wake_fd);
+    return 0;
+}
+
+int mpsc_pop_batch(MpscQueue *queue, GameEvent *events, int max)
+{
+    int count = 0;
+    while (count < max)
+    {
+        MpscSlot *slot = &queue->slots[queue->head & queue->mask];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != queue->head + 1)
+        {
+            break;
+        }
+        events[count++] = slot->event;
+        atomic_store_explicit(&slot->sequence, queue->head + queue->mask + 1, memory_order_release);
+        queue->head++;
+    }
+    return count;
+}
+
+static int mpsc_is_empty(void *arg)
+{
+    MpscQueue *queue = arg;
+    MpscSlot *slot = &queue->slots[queue->head & queue->mask];
+    return atomic_load(&slot->sequence) != queue->head + 1;
+}
+
+int mpsc_wait(MpscQueue *queue, int timeout_ms)
+{
+    return wait_on(&queue->sleeping, queue->wake_fd, mpsc_is_empty, queue, timeout_ms);
+}
+
+void mpsc_wake(MpscQueue *queue)
+{
+    signal_wake_fd(queue->wake_fd);
+}
+
+void mpsc_destroy(MpscQueue *queue)
+{
+    close(queue->wake_fd);
+    free(queue->slots);
+    queue->slots = NULL;
+}
@@ -0,0 +1,76 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "utils.h"
+#include <stdatomic.h>
+
+// Bounded lock-free rings that carry game events from the network loop to
+// service threads. The loop never blocks on them: a push into a full ring
+// fails and the caller drops the event. Consumers take events in batches
+// and sleep on an eventfd that producers only signal when a consumer is
+// actually asleep, so a busy consumer costs the producer no system call.
+
+#define QUEUE_CACHE_LINE 64
+
+typedef enum
+{
+    EVENT_MOVE = 1,
+    EVENT_GAME_END
+} GameEventType;
+
+typedef struct
+{
+    uint64_t time_ns; // CLOCK_MONOTONIC when the event was published
+    uint32_t game_id;
+    uint16_t ply;     // moves played in the game, this one included
+    PackedMove move;
+    uint8_t type;
+    char captured;
+    uint8_t result;   // ARCHIVE_* result of EVENT_GAME_END
+    uint8_t reserved[5];
+} GameEvent;
+
+// One producer, one consumer
+typedef struct
+{
+    _Alignas(QUEUE_CACHE_LINE) _Atomic size_t head; // next event to read, moved by the consumer
+    size_t cached_tail;
+    _Alignas(QUEUE_CACHE_LINE) _Atomic size_t tail; // next free slot, moved by the producer
+    size_t cached_head;
+    _Alignas(QUEUE_CACHE_LINE) size_t mask;
+    GameEvent *slots;
+    int wake_fd;
+    _Atomic int sleeping;
+} SpscQueue;
+
+typedef struct
+{
+    _Atomic size_t sequence;
+    GameEvent event;
+} MpscSlot;
+
+// Any number of producers, one consumer
+typedef struct
+{
+    _Alignas(QUEUE_CACHE_LINE) _Atomic size_t tail; // claimed by producers
+    _Alignas(QUEUE_CACHE_LINE) size_t head;         // consumer only
+    _Alignas(QUEUE_CACHE_LINE) size_t mask;
+    MpscSlot *slots;
+    int wake_fd;
+    _Atomic int sleeping;
+} MpscQueue;
+
+uint64_t event_clock_ns(void);
+int spsc_init(SpscQueue *queue, size_t capacity);
+int spsc_push(SpscQueue *queue, GameEvent *event);
+int spsc_pop_batch(SpscQueue *queue, GameEvent *events, int max);
+int spsc_wait(SpscQueue *queue, int timeout_ms);
+void spsc_wake(SpscQueue *queue);
+void spsc_destroy(SpscQueue *queue);
+int mpsc_init(MpscQueue *queue, size_t capacity);
+int mpsc_push(MpscQueue *queue, GameEvent *event);
+int mpsc_pop_batch(MpscQueue *queue, GameEvent *events, int max);
+int mpsc_wait(MpscQueue *queue, int timeout_ms);
+void mpsc_wake(MpscQueue *queue);
+void mpsc_destroy(MpscQueue *queue);
+#endif // QUEUE_H
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "utils.h"
+#include "fen.h"
+#include "history.h"
+#include "archive.h"
+
+// Replay an archive written by the server with --archive through the
+// current rule code and report every move where the rules now disagree
+// with what they said when the game was played.
+//
+// The archive is mapped and flows through three stages: one thread cuts it
+// into batches of games, worker threads replay the batches and the main
+// thread collects the results.
+
+#define GAMES_PER_BATCH 256
+#define QUEUE_SIZE 64
+#define MAX_THREADS 64
+
+typedef enum
+{
+    DIVERGED_NONE = 0,
+    DIVERGED_INVALID, // a recorded move is rejected
+    DIVERGED_CAPTURE, // a different piece was captured
+    DIVERGED_CHECK,   // the check verdict changed
+    DIVERGED_MATE,    // the mate verdict changed
+    DIVERGED_RESULT,  // the final mate gives a different winner than recorded
+    DIVERGED_FEN      // the starting position can not be loaded
+} DivergenceKind;
+
+typedef struct
+{
+    const ArchiveRecord *games[GAMES_PER_BATCH];
+    long first; // archive index of the first game
+    int count;
+} GameBatch;
+
+typedef struct
+{
+    long game;
+    int ply;
+    DivergenceKind kind;
+    MoveStatus status;
+    Move move;
+} Divergence;
+
+typedef struct
+{
+    int count;
+    long moves;
+    int divergence_count;
+    Divergence divergences[GAMES_PER_BATCH];
+} ResultBatch;
+
+// Bounded blocking queue between two stages
+typedef struct
+{
+    void *items[QUEUE_SIZE];
+    int head;
+    int count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} StageQueue;
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+    size_t end; // where the readable records stop
+} Archive;
+
+StageQueue decoded;
+StageQueue results;
+Archive archive;
+int threads = 1;
+int running_workers;
+pthread_mutex_t workers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void queue_init(StageQueue *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+void queue_push(StageQueue *queue, void *item)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == QUEUE_SIZE)
+    {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->items[(queue->head + queue->count) % QUEUE_SIZE] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Returns NULL once the queue is closed and empty
+void *queue_pop(StageQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed)
+    {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    void *item = NULL;
+    if (queue->count > 0)
+    {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % QUEUE_SIZE;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void queue_close(StageQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Stage 1: cut the archive into batches of games
+void *decode_stage(void *arg)
+{
+    (void)arg;
+    size_t offset = 0;
+    long index = 0;
+    GameBatch *batch = NULL;
+    const ArchiveRecord *record;
+
+    while ((record = archive_next(archive.data, archive.size, &offset)) != NULL)
+    {
+        if (batch == NULL)
+        {
+            batch = malloc(sizeof(GameBatch));
+            batch->first = index;
+            batch->count = 0;
+        }
+        batch->games[batch->count++] = record;
+        index++;
+        if (batch->count == GAMES_PER_BATCH)
+        {
+            queue_push(&decoded, batch);
+            batch = NULL;
+        }
+    }
+    if (batch != NULL)
+    {
+        queue_push(&decoded, batch);
+    }
+    archive.end = offset;
+    queue_close(&decoded);
+    return NULL;
+}
+
+// Play the game again, returns the number of moves replayed and fills in
+// the first divergence
+int replay_game(const ArchiveRecord *record, Divergence *divergence)
+{
+    ChessGame position;
+    const ArchiveMove *moves = (const ArchiveMove *)(record + 1);
+    char fen[FEN_MAX_LENGTH];
+
+    divergence->kind = DIVERGED_NONE;
+    memcpy(fen, record->start_fen, FEN_MAX_LENGTH);
+    fen[FEN_MAX_LENGTH - 1] = '\0';
+    memset(&position, 0, sizeof(position));
+    if (load_fen(&position, fen) != 0)
+    {
+        divergence->kind = DIVERGED_FEN;
+        divergence->ply = 0;
+        return 0;
+    }
+
+    for (uint32_t ply = 0; ply < record->move_count; ply++)
+    {
+        Move move = unpack_move(moves[ply].move);
+        int isPlayerWhite = position.current_player == 1;
+        divergence->ply = ply;
+        divergence->move = move;
+
+        divergence->status = validate_move(&position, &move, isPlayerWhite);
+        if (divergence->status != MOVE_VALID)
+        {
+            divergence->kind = DIVERGED_INVALID;
+            return ply;
+        }
+
+        char piece = position.board[move.from_row][move.from_col];
+        move_king(&position, &move);
+        char piece_taken = apply_move(&move, position.board);
+        update_position_state(&position, &move, piece, piece_taken);
+        if (piece_taken != moves[ply].captured)
+        {
+            divergence->kind = DIVERGED_CAPTURE;
+            return ply + 1;
+        }
+
+        int checked = is_king_checked(&position, !isPlayerWhite);
+        int mate = checked && is_checkmate(&position, &move, isPlayerWhite);
+        if (checked != ((moves[ply].state & ARCHIVE_CHECK) != 0))
+        {
+            divergence->kind = DIVERGED_CHECK;
+            return ply + 1;
+        }
+        if (mate != ((moves[ply].state & ARCHIVE_MATE) != 0))
+        {
+            divergence->kind = DIVERGED_MATE;
+            return ply + 1;
+        }
+        if (mate && ply + 1 == record->move_count &&
+            record->result != (isPlayerWhite ? ARCHIVE_WHITE_WINS : ARCHIVE_BLACK_WINS))
+        {
+            divergence->kind = DIVERGED_RESULT;
+            return ply + 1;
+        }
+        position.current_player = isPlayerWhite ? 2 : 1;
+    }
+    return record->move_count;
+}
+
+// Stage 2: replay the batches
+void *replay_stage(void *arg)
+{
+    (void)arg;
+    GameBatch *batch;
+    while ((batch = queue_pop(&decoded)) != NULL)
+    {
+        ResultBatch *result = malloc(sizeof(ResultBatch));
+        result->count = batch->count;
+        result->moves = 0;
+        result->divergence_count = 0;
+
+        for (int i = 0; i < batch->count; i++)
+        {
+            Divergence *divergence = &result->divergences[result->divergence_count];
+            result->moves += replay_game(batch->games[i], divergence);
+            if (divergence->kind != DIVERGED_NONE)
+            {
+                divergence->game = batch->first + i;
+                result->divergence_count++;
+            }
+        }
+        free(batch);
+        queue_push(&results, result);
+    }
+
+    // The last worker out tells the collector that no more results come
+    pthread_mutex_lock(&workers_lock);
+    if (--running_workers == 0)
+    {
+        queue_close(&results);
+    }
+    pthread_mutex_unlock(&workers_lock);
+    return NULL;
+}
+
+const char *divergence_message(Divergence *divergence)
+{
+    switch (divergence->kind)
+    {
+    case DIVERGED_INVALID:
+        return move_status_message(divergence->status);
+    case DIVERGED_CAPTURE:
+        return "a different piece was captured";
+    case DIVERGED_CHECK:
+        return "check verdict changed";
+    case DIVERGED_MATE:
+        return "mate verdict changed";
+    case DIVERGED_RESULT:
+        return "mate gives a different winner than the recorded result";
+    case DIVERGED_FEN:
+        return "starting position can not be loaded";
+    default:
+        return "";
+    }
+}
+
+void usage(char *name)
+{
+    printf("usage: %s [-j THREADS] ARCHIVE\n", name);
+    printf("OPTIONS\n");
+    printf("  -j --threads THREADS  replay with THREADS threads\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+    if (path == NULL || threads < 1 || threads > MAX_THREADS)
+    {
+        usage(argv[0]);
+    }
+
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) < 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    archive.size = info.st_size;
+    if (archive.size > 0)
+    {
+        archive.data = mmap(NULL, archive.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (archive.data == MAP_FAILED)
+        {
+            perror("mmap");
+            exit(1);
+        }
+        // The archive is read front to back once
+        madvise((void *)archive.data, archive.size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    queue_init(&decoded);
+    queue_init(&results);
+    running_workers = threads;
+    pthread_t decoder;
+    pthread_t workers[MAX_THREADS];
+    if (pthread_create(&decoder, NULL, decode_stage, NULL) != 0)
+    {
+        perror("pthread_create");
+        exit(1);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&workers[i], NULL, replay_stage, NULL) != 0)
+        {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+
+    // Stage 3: collect the results, batches may arrive out of order
+    long games = 0;
+    long moves = 0;
+    long diverged = 0;
+    ResultBatch *result;
+    while ((result = queue_pop(&results)) != NULL)
+    {
+        games += result->count;
+        moves += result->moves;
+        diverged += result->divergence_count;
+        for (int i = 0; i < result->divergence_count; i++)
+        {
+            Divergence *divergence = &result->divergences[i];
+            char move[5];
+            move[0] = 'a' + divergence->move.from_col;
+            move[1] = '8' - divergence->move.from_row;
+            move[2] = 'a' + divergence->move.to_col;
+            move[3] = '8' - divergence->move.to_row;
+            move[4] = '\0';
+            printf("game %ld, ply %d (%s): %s\n", divergence->game, divergence->ply + 1,
+                   divergence->kind == DIVERGED_FEN ? "-" : move, divergence_message(divergence));
+        }
+        free(result);
+    }
+
+    pthread_join(decoder, NULL);
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%ld games, %ld moves in %.3f s: %.0f games/s, %.0f moves/s, %ld diverged\n",
+           games, moves, seconds, seconds > 0 ? games / seconds : 0.0,
+           seconds > 0 ? moves / seconds : 0.0, diverged);
+    if (archive.end != archive.size)
+    {
+        printf("%lu bytes at the end of the archive are damaged\n", (unsigned long)(archive.size - archive.end));
+    }
+
+    if (archive.size > 0)
+    {
+        munmap((void *)archive.data, archive.size);
+    }
+    return diverged > 0 || archive.end != archive.size;
+}
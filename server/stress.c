@@ -0,0 +1,148 @@
+#include "utils.h"
+#include "fen.h"
+#include "history.h"
+#include "footprint.h"
+
+// Fill every game slot with a game a few moves in, as a host full of idle
+// games looks, and check the memory per game against a budget. A sample of
+// the games gets real loopback connections for the socket accounting.
+// Exits with 1 when the budget is exceeded.
+
+#define STRESS_CONNECTED_GAMES 128
+
+static const char *opening[] = {"e2e3", "e7e6", "d2d3", "d7d6"};
+
+static GameManager gm;
+
+static void start_game(ChessGame *game, ChessGame *start, int id)
+{
+    memset(game, 0, sizeof(*game));
+    game->game_id = id;
+    game->is_active = 1;
+    game->player1_socket = -1;
+    game->player2_socket = -1;
+    history_init(&game->history);
+    copy_position(game, start);
+
+    for (size_t i = 0; i < sizeof(opening) / sizeof(opening[0]); i++)
+    {
+        Move move = convert((char *)opening[i]);
+        move_king(game, &move);
+        char piece_taken = apply_move(&move, game->board);
+        update_position_state(game, &move, game->board[move.to_row][move.to_col], piece_taken);
+        history_push(&game->history, pack_move(&move, 0, piece_taken != '.' ? MOVE_FLAG_CAPTURE : 0), piece_taken);
+        game->current_player = game->current_player == 1 ? 2 : 1;
+    }
+}
+
+// Connect the first games to loopback sockets, each player leaves a move
+// unread. Returns the number of connected games.
+static int connect_games(int *client_fds)
+{
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listener, 64) < 0 || getsockname(listener, (struct sockaddr *)&address, &length) < 0)
+    {
+        perror("listen");
+        return 0;
+    }
+
+    int games = STRESS_CONNECTED_GAMES < MAX_GAMES ? STRESS_CONNECTED_GAMES : MAX_GAMES;
+    for (int i = 0; i < games * 2; i++)
+    {
+        client_fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+        if (client_fds[i] < 0 || connect(client_fds[i], (struct sockaddr *)&address, sizeof(address)) < 0)
+        {
+            perror("connect");
+            close(listener);
+            return i / 2;
+        }
+        int server_side = accept(listener, NULL, NULL);
+        ChessGame *game = &gm.games[i / 2];
+        if (i % 2 == 0)
+        {
+            game->player1_socket = server_side;
+        }
+        else
+        {
+            game->player2_socket = server_side;
+        }
+
+        // A move the server has not read yet
+        send(client_fds[i], "e2e3\n", 5, 0);
+    }
+    close(listener);
+    return games;
+}
+
+int main(int argc, char **argv)
+{
+    size_t budget = 2048;
+    ChessGame start;
+    ProcessFootprint before;
+    ProcessFootprint after;
+    GameFootprint games;
+    static int client_fds[STRESS_CONNECTED_GAMES * 2];
+
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0)
+        {
+            budget = atol(argv[++i]);
+        }
+    }
+
+    memset(&start, 0, sizeof(start));
+    load_fen(&start, START_FEN);
+    if (process_footprint(&before) < 0)
+    {
+        printf("stress: can not read the resident size\n");
+        return 1;
+    }
+
+    for (int i = 0; i < MAX_GAMES; i++)
+    {
+        start_game(&gm.games[i], &start, i);
+    }
+    gm.active_games = MAX_GAMES;
+    int connected = connect_games(client_fds);
+
+    process_footprint(&after);
+    game_footprint(&gm, &games);
+
+    size_t rss = after.rss_bytes - before.rss_bytes;
+    size_t heap = after.heap_in_use - before.heap_in_use;
+    size_t accounted = idle_game_bytes(&games);
+    size_t measured = rss / MAX_GAMES;
+
+    printf("stress: %d idle games, %lu bytes per game slot, %ld history chunks\n",
+           MAX_GAMES, (unsigned long)sizeof(ChessGame), games.history_chunks);
+    printf("stress: rss grew %.1f KB, heap %.1f KB\n", rss / 1024.0, heap / 1024.0);
+    printf("stress: %lu bytes per game measured, %lu accounted, budget %lu\n",
+           (unsigned long)measured, (unsigned long)accounted, (unsigned long)budget);
+    if (games.connections > 0)
+    {
+        printf("stress: %ld connections of %d games, %lu bytes of buffer limits and %lu bytes queued "
+               "in the kernel per connection\n",
+               games.connections, connected, (unsigned long)(games.socket_buffer_bytes / games.connections),
+               (unsigned long)(games.queued_bytes / games.connections));
+    }
+
+    for (int i = 0; i < connected * 2; i++)
+    {
+        close(client_fds[i]);
+    }
+
+    if (measured > budget || accounted > budget)
+    {
+        printf("stress: over the budget of %lu bytes per idle game\n", (unsigned long)budget);
+        return 1;
+    }
+    return 0;
+}
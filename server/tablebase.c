@@ -0,0 +1,226 @@
+#include "tablebase.h"
+#include <fcntl.h>
+#include <time.h>
+
+typedef struct
+{
+    int table;     // index into TABLEBASE_PIECES, -1 when the slot is empty
+    long page;
+    unsigned long last_used;
+    unsigned char data[TB_PAGE_SIZE];
+} CachedPage;
+
+static int table_fds[4] = {-1, -1, -1, -1};
+static CachedPage cache[TB_CACHE_PAGES];
+static unsigned long cache_clock = 0;
+static TablebaseStats stats;
+
+// Position order: side to move, colour of the extra piece, white king,
+// black king, extra piece, squares numbered row * 8 + col. Returns -1 when
+// the material is not a king and one piece against a bare king.
+long tablebase_index(ChessGame *game, char *piece)
+{
+    int white_king = -1;
+    int black_king = -1;
+    int extra = -1;
+
+    for (int square = 0; square < 64; square++)
+    {
+        char c = game->board[square / 8][square % 8];
+        if (c == '.')
+        {
+            continue;
+        }
+        if (c == 'K' && white_king < 0)
+        {
+            white_king = square;
+        }
+        else if (c == 'k' && black_king < 0)
+        {
+            black_king = square;
+        }
+        else if (extra < 0 && strchr(TABLEBASE_PIECES, toupper(c)) != NULL)
+        {
+            extra = square;
+            *piece = c;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    if (white_king < 0 || black_king < 0 || extra < 0)
+    {
+        return -1;
+    }
+
+    int side = game->current_player == 2;
+    int strong = *piece > 96;
+    return (((long)(side * 2 + strong) * 64 + white_king) * 64 + black_king) * 64 + extra;
+}
+
+// Set up the position of an index, returns 0 when two pieces would share a square
+int tablebase_position(long index, char piece, ChessGame *game)
+{
+    int extra = index % 64;
+    int black_king = index / 64 % 64;
+    int white_king = index / (64 * 64) % 64;
+    int strong = index / (64 * 64 * 64) % 2;
+    int side = index / (64 * 64 * 64 * 2);
+
+    if (white_king == black_king || extra == white_king || extra == black_king)
+    {
+        return 0;
+    }
+
+    memset(game->board, '.', sizeof(game->board));
+    game->board[white_king / 8][white_king % 8] = 'K';
+    game->board[black_king / 8][black_king % 8] = 'k';
+    game->board[extra / 8][extra % 8] = strong ? tolower(piece) : toupper(piece);
+    game->white_king.row = white_king / 8;
+    game->white_king.col = white_king % 8;
+    game->black_king.row = black_king / 8;
+    game->black_king.col = black_king % 8;
+    game->current_player = side ? 2 : 1;
+    game->castling = 0;
+    game->en_passant.row = -1;
+    game->en_passant.col = -1;
+    return 1;
+}
+
+// Open the tables found in the directory, returns how many there are
+int tablebase_open(const char *directory)
+{
+    int found = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char path[512];
+        TablebaseHeader header;
+        snprintf(path, sizeof(path), "%s/K%cK.tb", directory, TABLEBASE_PIECES[i]);
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            continue;
+        }
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            header.magic != TABLEBASE_MAGIC || header.version != TABLEBASE_VERSION ||
+            header.piece != TABLEBASE_PIECES[i] ||
+            lseek(fd, 0, SEEK_END) != (off_t)(sizeof(header) + TABLEBASE_POSITIONS))
+        {
+            printf("Tablebase %s is not a table of this version\n", path);
+            close(fd);
+            continue;
+        }
+        table_fds[i] = fd;
+        found++;
+    }
+
+    for (int i = 0; i < TB_CACHE_PAGES; i++)
+    {
+        cache[i].table = -1;
+    }
+    return found;
+}
+
+// The page holding the value, read from the file on a cache miss into the
+// least recently used slot. Returns NULL when the read failed.
+static CachedPage *get_page(int table, long page)
+{
+    CachedPage *oldest = &cache[0];
+    for (int i = 0; i < TB_CACHE_PAGES; i++)
+    {
+        if (cache[i].table == table && cache[i].page == page)
+        {
+            stats.cache_hits++;
+            cache[i].last_used = ++cache_clock;
+            return &cache[i];
+        }
+        if (cache[i].last_used < oldest->last_used)
+        {
+            oldest = &cache[i];
+        }
+    }
+
+    stats.cache_misses++;
+    off_t offset = sizeof(TablebaseHeader) + page * TB_PAGE_SIZE;
+    size_t size = TABLEBASE_POSITIONS - page * TB_PAGE_SIZE;
+    if (size > TB_PAGE_SIZE)
+    {
+        size = TB_PAGE_SIZE;
+    }
+    if (pread(table_fds[table], oldest->data, size, offset) != (ssize_t)size)
+    {
+        oldest->table = -1;
+        oldest->last_used = 0;
+        return NULL;
+    }
+    oldest->table = table;
+    oldest->page = page;
+    oldest->last_used = ++cache_clock;
+    return oldest;
+}
+
+// Returns 1 when the position is in an installed table
+int tablebase_probe(ChessGame *game, TablebaseResult *result)
+{
+    char piece;
+    long index = tablebase_index(game, &piece);
+    if (index < 0)
+    {
+        return 0;
+    }
+    int table = strchr(TABLEBASE_PIECES, toupper(piece)) - TABLEBASE_PIECES;
+    if (table_fds[table] < 0)
+    {
+        return 0;
+    }
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    CachedPage *page = get_page(table, index / TB_PAGE_SIZE);
+    int value = page != NULL ? page->data[index % TB_PAGE_SIZE] : TB_INVALID;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    stats.probes++;
+    stats.total_us += (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_nsec - start.tv_nsec) / 1000.0;
+
+    if (value == TB_INVALID)
+    {
+        return 0;
+    }
+    if (value == TB_DRAW)
+    {
+        result->result = 0;
+        result->plies = 0;
+    }
+    else if (value >= TB_LOSS)
+    {
+        result->result = -1;
+        result->plies = value - TB_LOSS;
+    }
+    else
+    {
+        result->result = 1;
+        result->plies = value;
+    }
+    return 1;
+}
+
+void tablebase_stats(TablebaseStats *result)
+{
+    *result = stats;
+}
+
+void tablebase_close(void)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (table_fds[i] >= 0)
+        {
+            close(table_fds[i]);
+            table_fds[i] = -1;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include "utils.h"
+
+// Endgame tables for a king and one piece against a bare king, solved with
+// the server's own move rules by mktb. A table file is a header followed by
+// one byte per position, see tablebase_index for the order.
+// Tables are read with pread through a small LRU page cache, so memory use
+// stays fixed however many tables are installed. They are not mapped: a
+// page fault would stall the event loop where no metric sees it, while a
+// miss in our cache is counted and timed.
+
+#define TABLEBASE_MAGIC 0x42544843 // "CHTB"
+#define TABLEBASE_VERSION 1
+#define TABLEBASE_POSITIONS (2 * 2 * 64 * 64 * 64)
+#define TABLEBASE_PIECES "QRBN"
+
+// Value bytes, distances are in plies. 1..126 means the side to move mates
+// in that many plies, TB_LOSS + n that it is mated in n plies.
+#define TB_DRAW 0
+#define TB_LOSS 128
+#define TB_MAX_PLIES 126
+#define TB_INVALID 255
+
+#define TB_NOT_TOLD 2 // ChessGame.tablebase_told before the first announcement
+
+#define TB_PAGE_SIZE 4096
+#define TB_CACHE_PAGES 64
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    char piece; // uppercase letter of the extra piece
+    char reserved[7];
+} TablebaseHeader;
+
+typedef struct
+{
+    int result; // 1 when the side to move wins, 0 for a draw, -1 when it loses
+    int plies;  // until mate
+} TablebaseResult;
+
+typedef struct
+{
+    long probes;
+    long cache_hits;
+    long cache_misses;
+    double total_us;
+} TablebaseStats;
+
+long tablebase_index(ChessGame *game, char *piece);
+int tablebase_position(long index, char piece, ChessGame *game);
+int tablebase_open(const char *directory);
+int tablebase_probe(ChessGame *game, TablebaseResult *result);
+void tablebase_stats(TablebaseStats *stats);
+void tablebase_close(void);
+#endif // TABLEBASE_H
@@ -0,0 +1,281 @@
+#include "tournament.h"
+
+int tournament_init(Tournament *tournament, int rounds, int capacity)
+{
+    memset(tournament, 0, sizeof(*tournament));
+    tournament->rounds = rounds;
+    tournament->capacity = capacity;
+    tournament->players = calloc(capacity, sizeof(TournamentPlayer));
+    tournament->pairings = malloc(sizeof(TournamentPairing) * (capacity / 2 + 1));
+    tournament->order = malloc(sizeof(int) * capacity);
+    int *opponents = malloc(sizeof(int) * capacity * rounds);
+    if (tournament->players == NULL || tournament->pairings == NULL || tournament->order == NULL ||
+        opponents == NULL)
+    {
+        free(opponents);
+        tournament_destroy(tournament);
+        return -1;
+    }
+    for (int i = 0; i < capacity; i++)
+    {
+        tournament->players[i].opponents = opponents + i * rounds;
+    }
+    return 0;
+}
+
+// Forget the players for the next tournament, the memory is kept
+void tournament_reset(Tournament *tournament)
+{
+    for (int i = 0; i < tournament->socket_slots; i++)
+    {
+        tournament->by_socket[i] = -1;
+    }
+    tournament->player_count = 0;
+    tournament->round = 0;
+    tournament->pairing_count = 0;
+}
+
+void tournament_destroy(Tournament *tournament)
+{
+    if (tournament->players != NULL)
+    {
+        free(tournament->players[0].opponents);
+    }
+    free(tournament->players);
+    free(tournament->pairings);
+    free(tournament->order);
+    free(tournament->by_socket);
+    memset(tournament, 0, sizeof(*tournament));
+}
+
+// Bytes allocated for the tournament
+size_t tournament_memory(Tournament *tournament)
+{
+    return (size_t)tournament->capacity * (sizeof(TournamentPlayer) + tournament->rounds * sizeof(int) + sizeof(int)) +
+           (tournament->players ? (tournament->capacity / 2 + 1) * sizeof(TournamentPairing) : 0) +
+           tournament->socket_slots * sizeof(int);
+}
+
+// Returns the player index, or -1 when the field is full or no memory is left
+int tournament_register(Tournament *tournament, int socket, unsigned int ip)
+{
+    if (tournament->round > 0 || tournament->player_count >= tournament->capacity)
+    {
+        return -1;
+    }
+
+    if (socket >= tournament->socket_slots)
+    {
+        int slots = tournament->socket_slots ? tournament->socket_slots * 2 : 1024;
+        while (slots <= socket)
+        {
+            slots *= 2;
+        }
+        int *by_socket = realloc(tournament->by_socket, sizeof(int) * slots);
+        if (by_socket == NULL)
+        {
+            return -1;
+        }
+        for (int i = tournament->socket_slots; i < slots; i++)
+        {
+            by_socket[i] = -1;
+        }
+        tournament->by_socket = by_socket;
+        tournament->socket_slots = slots;
+    }
+
+    int index = tournament->player_count++;
+    TournamentPlayer *player = &tournament->players[index];
+    player->socket = socket;
+    player->ip = ip;
+    player->points = 0;
+    player->color_balance = 0;
+    player->game = -1;
+    player->had_bye = 0;
+    for (int round = 0; round < tournament->rounds; round++)
+    {
+        player->opponents[round] = -1;
+    }
+    tournament->by_socket[socket] = index;
+    return index;
+}
+
+int tournament_find(Tournament *tournament, int socket)
+{
+    if (socket < 0 || socket >= tournament->socket_slots)
+    {
+        return -1;
+    }
+    return tournament->by_socket[socket];
+}
+
+// The player left, their results stay in the standings
+void tournament_withdraw(Tournament *tournament, int player)
+{
+    int socket = tournament->players[player].socket;
+    if (socket >= 0)
+    {
+        tournament->by_socket[socket] = -1;
+    }
+    tournament->players[player].socket = -1;
+}
+
+static int have_met(Tournament *tournament, int player, int opponent)
+{
+    for (int round = 0; round < tournament->round - 1; round++)
+    {
+        if (tournament->players[player].opponents[round] == opponent)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Pair the players still present for the next round. Players are taken by
+// score and matched with the next one they have not played yet; with an odd
+// count the lowest placed player without a bye sits out for a full point.
+// Returns the number of pairings, 0 when fewer than two players are left.
+int tournament_pair_round(Tournament *tournament)
+{
+    int count = tournament_standings(tournament);
+    int present = 0;
+    for (int i = 0; i < count; i++)
+    {
+        present += tournament->players[tournament->order[i]].socket >= 0;
+    }
+    tournament->pairing_count = 0;
+    if (present < 2 || tournament->round >= tournament->rounds)
+    {
+        return 0;
+    }
+    tournament->round++;
+
+    char *paired = calloc(count, 1);
+    if (paired == NULL)
+    {
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        paired[i] = tournament->players[tournament->order[i]].socket < 0;
+    }
+
+    int bye = -1;
+    if (present % 2 == 1)
+    {
+        for (int i = count - 1; i >= 0; i--)
+        {
+            if (!paired[i] && (bye < 0 || !tournament->players[tournament->order[i]].had_bye))
+            {
+                bye = i;
+                if (!tournament->players[tournament->order[i]].had_bye)
+                {
+                    break;
+                }
+            }
+        }
+        paired[bye] = 1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (paired[i])
+        {
+            continue;
+        }
+        int player = tournament->order[i];
+        int match = -1;
+        for (int j = i + 1; j < count; j++)
+        {
+            if (paired[j])
+            {
+                continue;
+            }
+            if (match < 0)
+            {
+                match = j; // a rematch when nobody else is left
+            }
+            if (!have_met(tournament, player, tournament->order[j]))
+            {
+                match = j;
+                break;
+            }
+        }
+
+        int opponent = tournament->order[match];
+        paired[i] = 1;
+        paired[match] = 1;
+
+        // The player who had black more often gets white, the higher placed
+        // one alternates colors between rounds otherwise
+        int balance = tournament->players[player].color_balance - tournament->players[opponent].color_balance;
+        int player_white = balance != 0 ? balance < 0 : tournament->round % 2 == 1;
+        TournamentPairing *pairing = &tournament->pairings[tournament->pairing_count++];
+        pairing->white = player_white ? player : opponent;
+        pairing->black = player_white ? opponent : player;
+    }
+
+    if (bye >= 0)
+    {
+        TournamentPlayer *player = &tournament->players[tournament->order[bye]];
+        player->points += 2;
+        player->had_bye = 1;
+        player->opponents[tournament->round - 1] = -1;
+        TournamentPairing *pairing = &tournament->pairings[tournament->pairing_count++];
+        pairing->white = tournament->order[bye];
+        pairing->black = -1;
+    }
+
+    free(paired);
+    return tournament->pairing_count;
+}
+
+// Result of a game of the current round, white_points is 2 for a white win,
+// 1 for a draw and 0 for a black win
+void tournament_record(Tournament *tournament, int white, int black, int white_points)
+{
+    TournamentPlayer *white_player = &tournament->players[white];
+    TournamentPlayer *black_player = &tournament->players[black];
+
+    white_player->points += white_points;
+    black_player->points += 2 - white_points;
+    white_player->opponents[tournament->round - 1] = black;
+    black_player->opponents[tournament->round - 1] = white;
+    white_player->color_balance++;
+    black_player->color_balance--;
+    white_player->game = -1;
+    black_player->game = -1;
+}
+
+// Sort every player by points into order, earlier registrations first on
+// equal points. Points are small, so this is a counting sort. Returns the
+// number of players.
+int tournament_standings(Tournament *tournament)
+{
+    int buckets = tournament->rounds * 2 + 2;
+    int *starts = calloc(buckets, sizeof(int));
+    if (starts == NULL)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < tournament->player_count; i++)
+    {
+        starts[buckets - 1 - tournament->players[i].points]++;
+    }
+    int position = 0;
+    for (int bucket = 0; bucket < buckets; bucket++)
+    {
+        int size = starts[bucket];
+        starts[bucket] = position;
+        position += size;
+    }
+    for (int i = 0; i < tournament->player_count; i++)
+    {
+        tournament->order[starts[buckets - 1 - tournament->players[i].points]++] = i;
+    }
+
+    free(starts);
+    return tournament->player_count;
+}
@@ -0,0 +1,51 @@
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include "utils.h"
+
+// Swiss tournament: players register until the field is full, then every
+// round pairs players with equal scores who have not met yet. Only the
+// standings and pairings live here, main.c runs the games.
+
+typedef struct
+{
+    int socket;        // -1 once the player left
+    unsigned int ip;
+    int points;        // half points
+    int color_balance; // games with white minus games with black
+    int game;          // game index during a round, -1 otherwise
+    int had_bye;
+    int *opponents;    // player index per round, -1 for a bye
+} TournamentPlayer;
+
+typedef struct
+{
+    int white;
+    int black; // -1 when white gets the bye
+} TournamentPairing;
+
+typedef struct
+{
+    TournamentPlayer *players; // in registration order
+    int player_count;
+    int capacity;    // registrations that start the first round
+    int rounds;
+    int round;       // 0 while registering
+    TournamentPairing *pairings;
+    int pairing_count;
+    int *order;      // player indices by score, for pairing and standings
+    int *by_socket;  // player index by socket, -1 for other sockets
+    int socket_slots;
+} Tournament;
+
+int tournament_init(Tournament *tournament, int rounds, int capacity);
+void tournament_reset(Tournament *tournament);
+void tournament_destroy(Tournament *tournament);
+size_t tournament_memory(Tournament *tournament);
+int tournament_register(Tournament *tournament, int socket, unsigned int ip);
+int tournament_find(Tournament *tournament, int socket);
+void tournament_withdraw(Tournament *tournament, int player);
+int tournament_pair_round(Tournament *tournament);
+void tournament_record(Tournament *tournament, int white, int black, int white_points);
+int tournament_standings(Tournament *tournament);
+#endif // TOURNAMENT_H
@@ -0,0 +1,325 @@
+#include "uring.h"
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int enter(Uring *ring, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size)
+{
+    ring->enters++;
+    return syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+// Make the prepared entries visible to the kernel, returns their number
+static unsigned publish(Uring *ring)
+{
+    unsigned count = ring->sqe_tail - *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    return count;
+}
+
+static void add_buffer(Uring *ring, int id)
+{
+    struct io_uring_buf *buffer = &ring->buffer_ring->bufs[ring->buffer_tail & (ring->buffer_count - 1)];
+    buffer->addr = (uint64_t)(uintptr_t)uring_buffer(ring, id);
+    buffer->len = ring->buffer_size;
+    buffer->bid = id;
+    ring->buffer_tail++;
+}
+
+static int map_rings(Uring *ring, struct io_uring_params *params)
+{
+    ring->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+        {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        return -1;
+    }
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            return -1;
+        }
+    }
+    ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        return -1;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_entries = params->sq_entries;
+    ring->sq_head = (unsigned *)(sq + params->sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params->sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params->sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params->sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params->cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params->cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+
+    // Entries are always handed over in the order they were taken
+    for (unsigned i = 0; i < ring->sq_entries; i++)
+    {
+        ring->sq_array[i] = i;
+    }
+    ring->sqe_tail = *ring->sq_tail;
+    return 0;
+}
+
+// buffer_count received chunks of buffer_size bytes can be waiting at once.
+// Returns -1 with errno set when the kernel lacks a feature the loop needs.
+int uring_init(Uring *ring, unsigned entries, int buffer_count, int buffer_size)
+{
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    // Completions are only run when the loop asks for them, so a burst of
+    // traffic never interrupts the loop. Older kernels lack these flags.
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4;
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0 && errno == EINVAL)
+    {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (ring->fd < 0)
+    {
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || map_rings(ring, &params) < 0)
+    {
+        uring_destroy(ring);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->buffer_count = buffer_count;
+    ring->buffer_size = buffer_size;
+    ring->buffer_ring = mmap(NULL, sizeof(struct io_uring_buf) * buffer_count, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buffers = malloc((size_t)buffer_count * buffer_size);
+    if (ring->buffer_ring == MAP_FAILED || ring->buffers == NULL)
+    {
+        if (ring->buffer_ring == MAP_FAILED)
+        {
+            ring->buffer_ring = NULL;
+        }
+        uring_destroy(ring);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring;
+    registration.ring_entries = buffer_count;
+    registration.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+    {
+        uring_destroy(ring);
+        return -1;
+    }
+    for (int i = 0; i < buffer_count; i++)
+    {
+        add_buffer(ring, i);
+    }
+    __atomic_store_n(&ring->buffer_ring->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Closing the ring cancels every request still in flight
+void uring_destroy(Uring *ring)
+{
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+    if (ring->buffer_ring != NULL)
+    {
+        munmap(ring->buffer_ring, sizeof(struct io_uring_buf) * ring->buffer_count);
+    }
+    free(ring->buffers);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+// Make room for count entries, submitting the prepared ones if needed, so
+// a chain taken after this is never split. Returns -1 on failure.
+int uring_reserve(Uring *ring, unsigned count)
+{
+    if (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) + count > ring->sq_entries)
+    {
+        if (enter(ring, publish(ring), 0, 0, NULL, 0) < 0 ||
+            ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) + count > ring->sq_entries)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// A cleared entry to fill in, NULL on failure
+struct io_uring_sqe *uring_get_sqe(Uring *ring)
+{
+    if (uring_reserve(ring, 1) < 0)
+    {
+        return NULL;
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqe_tail++;
+    return sqe;
+}
+
+// Submit the prepared entries and wait up to timeout_ms for a completion,
+// all in one system call. Returns -1 with errno set on failure.
+int uring_submit(Uring *ring, int timeout_ms)
+{
+    struct __kernel_timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    struct io_uring_getevents_arg arg;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uint64_t)(uintptr_t)&timeout;
+    unsigned count = publish(ring);
+    if (enter(ring, count, timeout_ms > 0, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0 &&
+        errno != ETIME && errno != EINTR)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// Copy out the next completion, returns 0 when there is none
+int uring_next_cqe(Uring *ring, struct io_uring_cqe *cqe)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    *cqe = ring->cqes[head & ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+char *uring_buffer(Uring *ring, int id)
+{
+    return ring->buffers + (size_t)id * ring->buffer_size;
+}
+
+// Give a provided buffer back to the kernel once its data was used
+void uring_recycle_buffer(Uring *ring, int id)
+{
+    add_buffer(ring, id);
+    __atomic_store_n(&ring->buffer_ring->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+}
+
+// One completion per accepted connection until the request ends
+void uring_prep_accept_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+}
+
+// One completion per received chunk, the data is in a provided buffer
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = user_data;
+}
+
+// One completion whenever the descriptor becomes readable
+void uring_prep_poll_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = user_data;
+}
+
+// The data must stay untouched until the send completes. The kernel keeps
+// sending until all of it went out, so a short send means an error.
+void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *data, size_t length, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = length;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_shutdown(struct io_uring_sqe *sqe, int fd, int how, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = fd;
+    sqe->len = how;
+    sqe->user_data = user_data;
+}
+
+// Cancel every request in flight
+void uring_prep_cancel_any(struct io_uring_sqe *sqe, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    sqe->user_data = user_data;
+}
+
+void uring_prep_close(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+{
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+}
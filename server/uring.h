@@ -0,0 +1,59 @@
+#ifndef URING_H
+#define URING_H
+
+#include "utils.h"
+#include <linux/io_uring.h>
+#include <stdint.h>
+
+// A minimal io_uring through the raw system calls, for the network loop:
+// multishot accept and recv, received data in a ring of provided buffers,
+// sends, shutdowns and closes that may be linked into chains. Only the thread that
+// created the ring may use it.
+
+#define URING_BUFFER_GROUP 0
+
+typedef struct
+{
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sqe_tail; // prepared entries, handed to the kernel on submit
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    struct io_uring_buf_ring *buffer_ring;
+    char *buffers;
+    int buffer_count; // a power of two
+    int buffer_size;
+    unsigned short buffer_tail;
+
+    long enters;      // io_uring_enter calls
+} Uring;
+
+int uring_init(Uring *ring, unsigned entries, int buffer_count, int buffer_size);
+void uring_destroy(Uring *ring);
+int uring_reserve(Uring *ring, unsigned count);
+struct io_uring_sqe *uring_get_sqe(Uring *ring);
+int uring_submit(Uring *ring, int timeout_ms);
+int uring_next_cqe(Uring *ring, struct io_uring_cqe *cqe);
+char *uring_buffer(Uring *ring, int id);
+void uring_recycle_buffer(Uring *ring, int id);
+void uring_prep_accept_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+void uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+void uring_prep_poll_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+void uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *data, size_t length, uint64_t user_data);
+void uring_prep_shutdown(struct io_uring_sqe *sqe, int fd, int how, uint64_t user_data);
+void uring_prep_cancel_any(struct io_uring_sqe *sqe, uint64_t user_data);
+void uring_prep_close(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+#endif // URING_H
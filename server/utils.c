@@ -125,144 +125,119 @@ int can_king_be_moved(ChessGame *game, int isPlayerWhite)
     return 0;
 }
 
-int check_validity(char piece, Move *move)
-{
-    switch (piece)
-    {
-    case 'k':
-        return is_king_one_square_move(move);
-    case 'q':
-        return is_diagonal_move(move) || is_straight_move(move);
-    case 'b':
-        return is_diagonal_move(move);
-    case 'n':
-        return is_knight_move(move);
-    case 'r':
-        return is_straight_move(move);
-    case 'p':
-        return is_pawn_one_square_move(move) || is_pawn_takes_move_validation(move);
-    default:
-        return 0;
+// Validators are generated per piece, and for pawns per color, so the
+// checks below dispatch with one indexed call instead of a switch on the
+// lower-cased piece. Tables are indexed by isPlayerWhite and the piece byte.
+typedef int (*PiecePattern)(Move *move);
+typedef MoveStatus (*PieceValidator)(char board[8][8], Move *move);
+
+#define PIECE_PATTERNS(X)                                         \
+    X(king, is_king_one_square_move(move))                        \
+    X(queen, is_diagonal_move(move) || is_straight_move(move))    \
+    X(bishop, is_diagonal_move(move))                             \
+    X(knight, is_knight_move(move))                               \
+    X(rook, is_straight_move(move))
+
+#define DEFINE_PATTERN(name, pattern)                                  \
+    static int pattern_##name(Move *move)                              \
+    {                                                                  \
+        return pattern;                                                \
+    }                                                                  \
+    static MoveStatus validate_##name(char board[8][8], Move *move)    \
+    {                                                                  \
+        (void)board;                                                   \
+        return pattern_##name(move) ? MOVE_VALID : MOVE_WRONG_PATTERN; \
     }
-}
 
-Tile get_board_indices(char *position)
+PIECE_PATTERNS(DEFINE_PATTERN)
+
+static int pattern_pawn(Move *move)
 {
-    Tile tile;
-    tile.col = position[0] - 'a';
-    tile.row = '8' - position[1];
-    return tile;
+    return is_pawn_one_square_move(move) || is_pawn_takes_move_validation(move);
 }
 
-int check_diagonals(char board[8][8], Tile *tile, int isPlayerWhite)
-{
-    char queen = isPlayerWhite ? 'q' : 'Q';
-    char bishop = isPlayerWhite ? 'b' : 'B';
-    int directions[4][2] = {
-        {1, 1},   // up-right
-        {1, -1},  // up-left
-        {-1, -1}, // down-left
-        {-1, 1}   // down-right
-    };
-    for (int dir = 0; dir < 4; dir++)
-    {
-        int col = tile->col;
-        int row = tile->row;
+// A diagonal pawn move is only decided by what stands on the target square
+#define DEFINE_PAWN_VALIDATOR(color, isPlayerWhite)                                     \
+    static MoveStatus validate_pawn_##color(char board[8][8], Move *move)               \
+    {                                                                                   \
+        if (is_pawn_takes_move_validation(move))                                        \
+        {                                                                               \
+            return is_pawn_takes(isPlayerWhite, move, board) ? MOVE_VALID               \
+                                                             : MOVE_PAWN_CANNOT_TAKE;   \
+        }                                                                               \
+        return is_pawn_one_square_move(move) ? MOVE_VALID : MOVE_WRONG_PATTERN;         \
+    }
 
-        do
-        {
-            col += directions[dir][0];
-            row += directions[dir][1];
-            char piece = board[row][col];
-            if (piece == queen || piece == bishop)
-            {
-                return 1;
-            }
-            if (piece != '.')
-            {
-                break;
-            }
-        } while (col > 0 && col < 7 && row > 0 && row < 7);
+DEFINE_PAWN_VALIDATOR(white, 1)
+DEFINE_PAWN_VALIDATOR(black, 0)
+
+#define DEFINE_REJECT(name, status)                                \
+    static MoveStatus reject_##name(char board[8][8], Move *move) \
+    {                                                              \
+        (void)board;                                               \
+        (void)move;                                                \
+        return status;                                             \
     }
 
+DEFINE_REJECT(empty, MOVE_NO_PIECE)
+DEFINE_REJECT(black_piece, MOVE_BLACK_PIECE)
+DEFINE_REJECT(white_piece, MOVE_WHITE_PIECE)
+DEFINE_REJECT(unknown, MOVE_WRONG_PATTERN)
+
+static PiecePattern piece_patterns[256];
+static PieceValidator piece_validators[2][256];
+
+static int no_pattern(Move *move)
+{
+    (void)move;
     return 0;
 }
 
-int check_straights(char board[8][8], Tile *tile, int isPlayerWhite)
+__attribute__((constructor)) static void init_piece_validators(void)
 {
-    char queen = isPlayerWhite ? 'q' : 'Q';
-    char rook = isPlayerWhite ? 'r' : 'R';
-    int directions[4][2] = {
-        {1, 0},  // down
-        {0, 1},  // right
-        {-1, 0}, // up
-        {0, -1}  // left
-    };
-    for (int dir = 0; dir < 4; dir++)
+    for (int byte = 0; byte < 256; byte++)
     {
-        int col = tile->col;
-        int row = tile->row;
-
-        // Move along the diagonal until edge of board
-        do
-        {
-            col += directions[dir][0];
-            row += directions[dir][1];
-            char piece = board[row][col];
-            if (piece == queen || piece == rook)
-            {
-                return 1;
-            }
-            if (piece != '.')
-            {
-                break;
-            }
-        } while (col > 0 && col < 7 && row > 0 && row < 7);
+        char piece = (char)byte;
+        piece_patterns[byte] = no_pattern;
+        piece_validators[1][byte] = piece == '.' ? reject_empty : piece > 96 ? reject_black_piece : reject_unknown;
+        piece_validators[0][byte] = piece == '.' ? reject_empty : piece < 96 ? reject_white_piece : reject_unknown;
     }
 
-    return 0;
+    piece_patterns['k'] = pattern_king;
+    piece_patterns['q'] = pattern_queen;
+    piece_patterns['b'] = pattern_bishop;
+    piece_patterns['n'] = pattern_knight;
+    piece_patterns['r'] = pattern_rook;
+    piece_patterns['p'] = pattern_pawn;
+
+    piece_validators[1]['K'] = piece_validators[0]['k'] = validate_king;
+    piece_validators[1]['Q'] = piece_validators[0]['q'] = validate_queen;
+    piece_validators[1]['B'] = piece_validators[0]['b'] = validate_bishop;
+    piece_validators[1]['N'] = piece_validators[0]['n'] = validate_knight;
+    piece_validators[1]['R'] = piece_validators[0]['r'] = validate_rook;
+    piece_validators[1]['P'] = validate_pawn_white;
+    piece_validators[0]['p'] = validate_pawn_black;
 }
 
-int check_knight(char board[8][8], Tile *tile, int isPlayerWhite)
+// Movement pattern of a lower-case piece, ignoring what stands on the board
+int check_validity(char piece, Move *move)
 {
-    char knight = isPlayerWhite ? 'n' : 'N';
-    int directions[8][2] = {
-        {2, 1},
-        {1, 2},
-        {2, -1},
-        {1, -2},
-        {-2, 1},
-        {-1, 2},
-        {-2, -1},
-        {-1, -2}};
-    for (int dir = 0; dir < 8; dir++)
-    {
-        int col = tile->col + directions[dir][0];
-        int row = tile->row + directions[dir][1];
+    return piece_patterns[(unsigned char)piece](move);
+}
 
-        if (col >= 0 && col < 8 && row >= 0 && row < 8)
-        {
-            char piece = board[row][col];
-            if (piece == knight)
-            {
-                return 1;
-            }
-        }
-    }
-    return 0;
+Tile get_board_indices(char *position)
+{
+    Tile tile;
+    tile.col = position[0] - 'a';
+    tile.row = '8' - position[1];
+    return tile;
 }
 
 int is_king_checked(ChessGame *game, int isPlayerWhite)
 {
     Tile tile = isPlayerWhite ? game->white_king : game->black_king;
 
-    int diag = check_diagonals(game->board, &tile, isPlayerWhite);
-
-    int straight = check_straights(game->board, &tile, isPlayerWhite);
-
-    int knight = check_knight(game->board, &tile, isPlayerWhite);
-
-    return diag || straight || knight;
+    return is_tile_attacked(game->board, &tile, isPlayerWhite);
 }
 
 int can_be_taken(ChessGame *game, Move *move, int isPlayerWhite)
@@ -271,13 +246,7 @@ int can_be_taken(ChessGame *game, Move *move, int isPlayerWhite)
     tile.col = move->to_col;
     tile.row = move->to_row;
 
-    int diag = check_diagonals(game->board, &tile, isPlayerWhite);
-
-    int straight = check_straights(game->board, &tile, isPlayerWhite);
-
-    int knight = check_knight(game->board, &tile, isPlayerWhite);
-
-    return diag || straight || knight;
+    return is_tile_attacked(game->board, &tile, isPlayerWhite);
 }
 
 int get_step(int a, int b)
@@ -299,6 +268,15 @@ int can_be_blocked(ChessGame *game, Move *move, int isPlayerWhite)
     int x_step = get_step(attacking_tile.row, tile.row);
     int y_step = get_step(attacking_tile.col, tile.col);
 
+    // A knight, or any attacker off the king's lines, can not be blocked and
+    // the walk below would never reach the king
+    int row_distance = abs(attacking_tile.row - tile.row);
+    int col_distance = abs(attacking_tile.col - tile.col);
+    if (row_distance != 0 && col_distance != 0 && row_distance != col_distance)
+    {
+        return 0;
+    }
+
     int current_x = attacking_tile.row;
     int current_y = attacking_tile.col;
 
@@ -315,16 +293,166 @@ int can_be_blocked(ChessGame *game, Move *move, int isPlayerWhite)
         Tile new_tile;
         new_tile.col = current_y;
         new_tile.row = current_x;
-        int diag = check_diagonals(game->board, &new_tile, !isPlayerWhite);
+        if (is_tile_attacked(game->board, &new_tile, !isPlayerWhite))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+Move convert(char *move)
+{
+    Move move_obj;
 
-        int straight = check_straights(game->board, &new_tile, !isPlayerWhite);
+    move_obj.from_col = move[0] - 'a';
+    move_obj.from_row = '8' - move[1];
+    move_obj.to_col = move[2] - 'a';
+    move_obj.to_row = '8' - move[3];
 
-        int knight = check_knight(game->board, &new_tile, !isPlayerWhite);
+    return move_obj;
+}
+
+int apply_move(Move *move, char board[8][8])
+{
+    char piece_taken = board[move->to_row][move->to_col];
+    board[move->to_row][move->to_col] = board[move->from_row][move->from_col];
+    board[move->from_row][move->from_col] = '.';
+    return piece_taken;
+}
 
-        if (diag || straight || knight)
+void revert_move(Move *move, char board[8][8], char piece_taken)
+{
+    board[move->from_row][move->from_col] = board[move->to_row][move->to_col];
+    board[move->to_row][move->to_col] = piece_taken;
+}
+
+// Find both kings on the board, used when the board was not built by init_board
+void locate_kings(ChessGame *game)
+{
+    for (int row = 0; row < 8; row++)
+    {
+        for (int col = 0; col < 8; col++)
         {
-            return 1;
+            Tile tile;
+            tile.row = row;
+            tile.col = col;
+            if (game->board[row][col] == 'K')
+            {
+                game->white_king = tile;
+            }
+            if (game->board[row][col] == 'k')
+            {
+                game->black_king = tile;
+            }
         }
     }
-    return 0;
+}
+
+// Checks that only depend on the moving piece, without playing the move
+MoveStatus check_move_pattern(char board[8][8], Move *move, int isPlayerWhite)
+{
+    // check boundaries
+    if (move->from_col < 0 || move->from_col > 7 || move->from_row < 0 || move->from_row > 7 ||
+        move->to_col < 0 || move->to_col > 7 || move->to_row < 0 || move->to_row > 7)
+    {
+        return MOVE_OUT_OF_BOARD;
+    }
+
+    if (move->from_col == move->to_col && move->from_row == move->to_row)
+    {
+        return MOVE_NO_MOVE;
+    }
+
+    char piece = board[move->from_row][move->from_col];
+    return piece_validators[isPlayerWhite != 0][(unsigned char)piece](board, move);
+}
+
+// Full validation of a move, the game is left unchanged
+MoveStatus validate_move(ChessGame *game, Move *move, int isPlayerWhite)
+{
+    MoveStatus status = check_move_pattern(game->board, move, isPlayerWhite);
+    if (status != MOVE_VALID)
+    {
+        return status;
+    }
+
+    char target = game->board[move->to_row][move->to_col];
+    int is_target_black = target > 96;
+    if (target != '.' && isPlayerWhite != is_target_black)
+    {
+        return MOVE_OWN_PIECE;
+    }
+
+    Tile white_king = game->white_king;
+    Tile black_king = game->black_king;
+
+    move_king(game, move);
+    char piece_taken = apply_move(move, game->board);
+    int is_checked = is_king_checked(game, isPlayerWhite);
+    revert_move(move, game->board, piece_taken);
+
+    game->white_king = white_king;
+    game->black_king = black_king;
+
+    return is_checked ? MOVE_KING_EXPOSED : MOVE_VALID;
+}
+
+const char *move_status_message(MoveStatus status)
+{
+    switch (status)
+    {
+    case MOVE_VALID:
+        return "OK";
+    case MOVE_OUT_OF_BOARD:
+        return "Invalid move coordinates!";
+    case MOVE_NO_MOVE:
+        return "You have to make a move!";
+    case MOVE_NO_PIECE:
+        return "You have to move an existing piece!";
+    case MOVE_BLACK_PIECE:
+        return "You can't move black's pieces!";
+    case MOVE_WHITE_PIECE:
+        return "You can't move white's pieces!";
+    case MOVE_PAWN_CANNOT_TAKE:
+        return "Pawns can only move diagonally to take a piece!";
+    case MOVE_WRONG_PATTERN:
+        return "This move cannot be played by this piece!";
+    case MOVE_OWN_PIECE:
+        return "You can't take your own pieces!";
+    case MOVE_KING_EXPOSED:
+        return "This move is illegal as this piece is protecting your king from check";
+    default:
+        return "Unknown move status";
+    }
+}
+
+// Validate a batch of (position, move) pairs, returns how many were valid.
+// Every check works on its own copy of the position, so slices of one batch
+// can be validated from different threads.
+int validate_moves(MoveCheck *checks, int count)
+{
+    int valid = 0;
+    for (int i = 0; i < count; i++)
+    {
+        checks[i].status = validate_move(&checks[i].position, &checks[i].move, checks[i].isPlayerWhite);
+        if (checks[i].status == MOVE_VALID)
+        {
+            valid++;
+        }
+    }
+    return valid;
+}
+
+// Whether the opponent of the player who just moved can not get out of check
+int is_checkmate(ChessGame *game, Move *move, int isPlayerWhite)
+{
+    if (!is_king_checked(game, !isPlayerWhite))
+    {
+        return 0;
+    }
+    int a = can_king_be_moved(game, !isPlayerWhite);
+    int b = can_be_taken(game, move, isPlayerWhite);
+    int c = can_be_blocked(game, move, !isPlayerWhite);
+    return !a && !b && !c;
 }
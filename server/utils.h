@@ -12,8 +12,17 @@
 #include <signal.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
+#include <stdint.h>
 
+// Player socket of the engine, sends to it fail without effect
+#define BOT_SOCKET -2
+
+#ifndef MAX_GAMES
 #define MAX_GAMES 50
+#endif
+
+#define FEN_MAX_LENGTH 100
 
 typedef struct
 {
@@ -21,10 +30,33 @@ typedef struct
     int col;
 } Tile;
 
+// Moves packed into 16 bits: from square (bits 0-5), to square (6-11),
+// promotion piece (12-13) and MOVE_FLAG_* (14-15), squares are row * 8 + col
+typedef uint16_t PackedMove;
+
+#define HISTORY_CHUNK_MOVES 32
+
+typedef struct HistoryChunk
+{
+    struct HistoryChunk *next;
+    PackedMove moves[HISTORY_CHUNK_MOVES];
+    char captured[HISTORY_CHUNK_MOVES]; // '.' when nothing was taken
+    unsigned char states[HISTORY_CHUNK_MOVES]; // MOVE_CHECK and MOVE_MATE after the move
+} HistoryChunk;
+
+typedef struct
+{
+    HistoryChunk *first;
+    HistoryChunk *last;
+    int count;
+} MoveHistory;
+
 typedef struct
 {
     int player1_socket;
     int player2_socket;
+    unsigned int player1_ip; // network byte order
+    unsigned int player2_ip;
     char board[8][8];
     int current_player;
     int turn;
@@ -34,6 +66,16 @@ typedef struct
     Tile black_king;
     int white_checked;
     int black_checked;
+    int castling;       // CASTLE_* flags
+    Tile en_passant;    // row is -1 when there is no en passant square
+    int halfmove_clock; // moves since the last capture or pawn move
+    int bot_player;     // 2 when black is played by the engine, 0 otherwise
+    unsigned int bot_ticket;
+    time_t waiting_since;
+    MoveHistory history;
+    int book_plies; // leading moves of the game that came from the opening book
+    int tablebase_told; // result last announced from White's side: 1, 0, -1, or TB_NOT_TOLD
+    char start_fen[FEN_MAX_LENGTH]; // position the game started from, for PGN and the archive
 } ChessGame;
 
 typedef struct
@@ -50,6 +92,30 @@ typedef struct
     int to_col;
 } Move;
 
+// Result of validating a single move, MOVE_VALID when the move can be played
+typedef enum
+{
+    MOVE_VALID = 0,
+    MOVE_OUT_OF_BOARD,
+    MOVE_NO_MOVE,
+    MOVE_NO_PIECE,
+    MOVE_BLACK_PIECE,
+    MOVE_WHITE_PIECE,
+    MOVE_PAWN_CANNOT_TAKE,
+    MOVE_WRONG_PATTERN,
+    MOVE_OWN_PIECE,
+    MOVE_KING_EXPOSED
+} MoveStatus;
+
+// One (position, move) pair of a batch validation
+typedef struct
+{
+    ChessGame position;
+    Move move;
+    int isPlayerWhite;
+    MoveStatus status;
+} MoveCheck;
+
 void init_game_manager(GameManager *gm);
 int find_available_game(GameManager *gm);
 ChessGame *find_game_by_socket(GameManager *gm, int socket);
@@ -62,6 +128,7 @@ int check_validity(char piece, Move *move);
 int check_diagonals(char board[8][8], Tile *tile, int isPlayerWhite);
 int check_straights(char board[8][8], Tile *tile, int isPlayerWhite);
 int check_knight(char board[8][8], Tile *tile, int isPlayerWhite);
+int is_tile_attacked(char board[8][8], Tile *tile, int isPlayerWhite);
 int is_king_checked(ChessGame *game, int isPlayerWhite);
 int is_pawn_takes_move_validation(Move *move);
 int is_pawn_takes(int isPlayerWhite, Move *move, char board[8][8]);
@@ -69,4 +136,13 @@ void move_king(ChessGame *game, Move *move);
 int can_king_be_moved(ChessGame *game, int isPlayerWhite);
 int can_be_taken(ChessGame *game, Move *move, int isPlayerWhite);
 int can_be_blocked(ChessGame *game, Move *move, int isPlayerWhite);
+Move convert(char *move);
+int apply_move(Move *move, char board[8][8]);
+void revert_move(Move *move, char board[8][8], char piece_taken);
+void locate_kings(ChessGame *game);
+MoveStatus check_move_pattern(char board[8][8], Move *move, int isPlayerWhite);
+MoveStatus validate_move(ChessGame *game, Move *move, int isPlayerWhite);
+const char *move_status_message(MoveStatus status);
+int validate_moves(MoveCheck *checks, int count);
+int is_checkmate(ChessGame *game, Move *move, int isPlayerWhite);
 #endif // UTILS_H
\ No newline at end of file